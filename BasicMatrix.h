@@ -0,0 +1,438 @@
+#ifndef BASICMATRIX_H_
+#define BASICMATRIX_H_
+
+#include "Matrix.h"
+#include "FixedPoint.h"
+#include "MatrixSimd.h"
+
+// r[0..p) = a[0..n) times the row-major n x p b, r zeroed on entry: the
+// floating-point row of BasicMatrix::dot. Generic types combine the rows
+// of b one at a time.
+template<typename T>
+inline void basic_dot_row(const T* a, const T* b, mdim_t n, mdim_t p, T* r) {
+	for (mdim_t k=0; k<n; k++) {
+		const T* bk = b + (msize_t)k * p;
+		for (mdim_t j=0; j<p; j++)
+			r[j] += a[k] * bk[j];
+	}
+}
+
+// float and double keep two vectors of r in registers across all of k,
+// adding up in the same order as the generic loop
+template<typename V, int W, typename T>
+inline void basic_dot_row_simd(const T* a, const T* b, mdim_t n, mdim_t p, T* r) {
+	mdim_t j = 0;
+	for (; j + 2 * W <= p; j += 2 * W) {
+		V acc0 = simd_set1((T)0), acc1 = acc0;
+		for (mdim_t k=0; k<n; k++) {
+			V ak = simd_set1(a[k]);
+			const T* bk = b + (msize_t)k * p + j;
+			acc0 = simd_fmadd(ak, simd_load(bk), acc0);
+			acc1 = simd_fmadd(ak, simd_load(bk + W), acc1);
+		}
+		simd_store(r + j, acc0);
+		simd_store(r + j + W, acc1);
+	}
+	for (; j + W <= p; j += W) {
+		V acc = simd_set1((T)0);
+		for (mdim_t k=0; k<n; k++)
+			acc = simd_fmadd(simd_set1(a[k]), simd_load(b + (msize_t)k * p + j), acc);
+		simd_store(r + j, acc);
+	}
+	for (; j<p; j++) {
+		T acc = 0;
+		for (mdim_t k=0; k<n; k++)
+			acc += a[k] * b[(msize_t)k * p + j];
+		r[j] = acc;
+	}
+}
+
+inline void basic_dot_row(const float* a, const float* b, mdim_t n, mdim_t p, float* r) {
+	basic_dot_row_simd<simd_f, SIMD_WIDTH_F>(a, b, n, p, r);
+}
+
+inline void basic_dot_row(const double* a, const double* b, mdim_t n, mdim_t p, double* r) {
+	basic_dot_row_simd<simd_d, SIMD_WIDTH>(a, b, n, p, r);
+}
+
+// Dynamic row-major matrix over any element type with ScalarTraits: float,
+// double, or the saturating Q15/Q31 fixed-point types. Covers the core of
+// Matrix (arithmetic, dot, transpose, trace, norm, cross and the
+// quaternion functions) with plain loops, except that float and double dot
+// products run on SIMD vectors, holding twice as many floats as doubles.
+// Sums of products go through the element's accumulator, so Q15/Q31 dot
+// products carry full precision and round once per output.
+//
+//    MatrixQ15 a(A), b(B);       // from double Matrix, saturating to [-1, 1)
+//    MatrixQ15 c = a.dot(b);
+//    Matrix back = c.toMatrix();
+//
+// Matrix itself stays the double implementation with the gemm,
+// expression template and allocator paths; BasicMatrix<double> is the
+// same arithmetic without them, useful as a reference for the others.
+template<typename T>
+class BasicMatrix {
+public:
+	typedef ScalarTraits<T> Traits;
+	typedef typename Traits::Accumulator Accumulator;
+
+	// wraps data without owning it when given, otherwise zero-filled storage
+	BasicMatrix(mdim_t m=0, mdim_t n=0, T* data=0) : data(data), m(m), n(n), isAllocated(false) {
+		if (!data)
+			allocate();
+	}
+	BasicMatrix(const BasicMatrix& rhs) : data(0), m(0), n(0), isAllocated(false) {
+		*this = rhs;
+	}
+	BasicMatrix(BasicMatrix&& rhs) : data(rhs.data), m(rhs.m), n(rhs.n), isAllocated(rhs.isAllocated) {
+		rhs.data = 0;
+		rhs.isAllocated = false;
+		rhs.m = 0;
+		rhs.n = 0;
+	}
+	// from a double Matrix, saturating for fixed point
+	explicit BasicMatrix(const Matrix& rhs) : data(0), m(rhs.m), n(rhs.n), isAllocated(false) {
+		allocate();
+		for (mdim_t i=0; i<m; i++)
+			for (mdim_t j=0; j<n; j++)
+				data[(msize_t)i * n + j] = Traits::fromDouble(rhs.get(i, j));
+	}
+	~BasicMatrix() {
+		release();
+	}
+
+	BasicMatrix& operator=(const BasicMatrix& rhs) {
+		if (this == &rhs)
+			return *this;
+		if ((msize_t)m * n != (msize_t)rhs.m * rhs.n || !data) {
+			m = rhs.m;
+			n = rhs.n;
+			allocate();
+		}
+		m = rhs.m;
+		n = rhs.n;
+		return copyData(rhs.data);
+	}
+	BasicMatrix& operator=(BasicMatrix&& rhs) {
+		if (this == &rhs)
+			return *this;
+		// aliases on either side keep copy semantics
+		if (!rhs.isAllocated || (!isAllocated && data && size() == rhs.size()))
+			return *this = static_cast<const BasicMatrix&>(rhs);
+		release();
+		data = rhs.data;
+		m = rhs.m;
+		n = rhs.n;
+		isAllocated = true;
+		rhs.data = 0;
+		rhs.isAllocated = false;
+		rhs.m = 0;
+		rhs.n = 0;
+		return *this;
+	}
+
+	// the diagonal saturates to just below 1 for fixed point
+	static BasicMatrix identity(mdim_t m) {
+		BasicMatrix result(m, m);
+		for (mdim_t i=0; i<m; i++)
+			result.data[(msize_t)i * m + i] = Traits::fromDouble(1.0);
+		return result;
+	}
+
+	BasicMatrix& copyData(const T* values) {
+		for (msize_t k=0; k<size(); k++)
+			data[k] = values[k];
+		return *this;
+	}
+	Matrix toMatrix() const {
+		Matrix result(m, n);
+		for (msize_t k=0; k<size(); k++)
+			result.data[k] = Traits::toDouble(data[k]);
+		return result;
+	}
+
+	T& operator()(mdim_t i, mdim_t j=0) { return data[(msize_t)i * n + j]; }
+	const T& get(mdim_t i, mdim_t j) const { return data[(msize_t)i * n + j]; }
+	T& set(mdim_t i, mdim_t j) { return data[(msize_t)i * n + j]; }
+	msize_t size() const { return (msize_t)m * n; }
+
+	BasicMatrix& operator+=(const BasicMatrix& rhs) {
+		for (msize_t k=0; k<size(); k++)
+			data[k] += rhs.data[k];
+		return *this;
+	}
+	BasicMatrix& operator-=(const BasicMatrix& rhs) {
+		for (msize_t k=0; k<size(); k++)
+			data[k] -= rhs.data[k];
+		return *this;
+	}
+	BasicMatrix& operator*=(T scalar) {
+		for (msize_t k=0; k<size(); k++)
+			data[k] *= scalar;
+		return *this;
+	}
+	// element-wise
+	BasicMatrix& multiplySelf(const BasicMatrix& rhs) {
+		for (msize_t k=0; k<size(); k++)
+			data[k] *= rhs.data[k];
+		return *this;
+	}
+	BasicMatrix operator+(const BasicMatrix& rhs) const { BasicMatrix r(*this); return r += rhs; }
+	BasicMatrix operator-(const BasicMatrix& rhs) const { BasicMatrix r(*this); return r -= rhs; }
+	BasicMatrix operator*(T scalar) const { BasicMatrix r(*this); return r *= scalar; }
+
+	bool operator==(const BasicMatrix& other) const {
+		if (m != other.m || n != other.n)
+			return false;
+		for (msize_t k=0; k<size(); k++)
+			if (data[k] != other.data[k])
+				return false;
+		return true;
+	}
+	bool operator!=(const BasicMatrix& other) const { return !(*this == other); }
+	// compared as doubles
+	bool closeEnough(const BasicMatrix& another, double tolerance=1.0e-6) const {
+		if (m != another.m || n != another.n)
+			return false;
+		for (msize_t k=0; k<size(); k++)
+			if (fabs(Traits::toDouble(data[k]) - Traits::toDouble(another.data[k])) > tolerance)
+				return false;
+		return true;
+	}
+
+	// this * rhs, an empty matrix on shape mismatch
+	BasicMatrix dot(const BasicMatrix& rhs) const {
+		if (n != rhs.m)
+			return BasicMatrix(0, 0);
+		mdim_t p = rhs.n;
+		BasicMatrix result(m, p);
+		for (mdim_t i=0; i<m; i++) {
+			const T* a = data + (msize_t)i * n;
+			T* r = result.data + (msize_t)i * p;
+			if (Traits::floating) {
+				// row i as a combination of the rows of rhs, unit stride throughout
+				basic_dot_row(a, rhs.data, n, p, r);
+			} else {
+				for (mdim_t j=0; j<p; j++) {
+					Accumulator acc = Accumulator();
+					for (mdim_t k=0; k<n; k++)
+						Traits::mac(acc, a[k], rhs.data[(msize_t)k * p + j]);
+					r[j] = Traits::round(acc);
+				}
+			}
+		}
+		return result;
+	}
+
+	BasicMatrix transposed() const {
+		BasicMatrix result(n, m);
+		for (mdim_t i=0; i<m; i++)
+			for (mdim_t j=0; j<n; j++)
+				result.data[(msize_t)j * m + i] = data[(msize_t)i * n + j];
+		return result;
+	}
+
+	// Gauss-Jordan with partial pivoting, in place; releases the matrix
+	// (0 x 0) when singular. Floating point only: the in-place scheme
+	// needs 1 and reciprocals of the pivots, which fixed point cannot hold.
+	BasicMatrix& inverse() {
+		static_assert(Traits::floating, "inverse needs a floating-point element type");
+		if (m != n) {
+			release();
+			return *this;
+		}
+		mdim_t small[16];
+		mdim_t* pivrows = n <= 16 ? small : new mdim_t[n];
+		for (mdim_t k=0; k<n; k++) {
+			mdim_t pivrow = k;
+			T best = 0;
+			for (mdim_t i=k; i<n; i++)
+				if (Traits::abs(get(i, k)) > best) {
+					best = Traits::abs(get(i, k));
+					pivrow = i;
+				}
+			if (best == 0) {
+				if (pivrows != small)
+					delete[] pivrows;
+				release();
+				return *this;
+			}
+			if (pivrow != k)
+				for (mdim_t j=0; j<n; j++) {
+					T tmp = get(k, j);
+					set(k, j) = get(pivrow, j);
+					set(pivrow, j) = tmp;
+				}
+			pivrows[k] = pivrow;
+
+			T inv = 1 / get(k, k);
+			set(k, k) = 1;
+			T* rk = data + (msize_t)k * n;
+			for (mdim_t j=0; j<n; j++)
+				rk[j] *= inv;
+			for (mdim_t i=0; i<n; i++) {
+				if (i == k)
+					continue;
+				T* ri = data + (msize_t)i * n;
+				T f = ri[k];
+				ri[k] = 0;
+				for (mdim_t j=0; j<n; j++)
+					ri[j] -= rk[j] * f;
+			}
+		}
+		// undo the row swaps as column swaps, last first
+		for (mdim_t k=n; k-- > 0; )
+			if (pivrows[k] != k)
+				for (mdim_t i=0; i<n; i++) {
+					T tmp = get(i, k);
+					set(i, k) = get(i, pivrows[k]);
+					set(i, pivrows[k]) = tmp;
+				}
+		if (pivrows != small)
+			delete[] pivrows;
+		return *this;
+	}
+
+	T trace() const {
+		T result = T();
+		for (mdim_t i=0; i<m && i<n; i++)
+			result += get(i, i);
+		return result;
+	}
+	T sum() const {
+		T result = T();
+		for (msize_t k=0; k<size(); k++)
+			result += data[k];
+		return result;
+	}
+	// Frobenius norm, saturates at the top of the range for fixed point
+	T norm() const {
+		Accumulator acc = Accumulator();
+		for (msize_t k=0; k<size(); k++)
+			Traits::mac(acc, data[k], data[k]);
+		return Traits::sqrt(acc);
+	}
+	// divides by the norm (not by its reciprocal, which fixed point cannot hold)
+	BasicMatrix& normalize() {
+		T k = norm();
+		if (k > T())
+			for (msize_t i=0; i<size(); i++)
+				data[i] = data[i] / k;
+		return *this;
+	}
+
+	// 1x3 row vectors
+	BasicMatrix cross(const BasicMatrix& rhs) const {
+		if (m != 1 || n != 3 || rhs.m != 1 || rhs.n != 3)
+			return BasicMatrix(0, 0);
+		const T* a = data;
+		const T* b = rhs.data;
+		BasicMatrix result(1, 3);
+		result.data[0] = mac2(a[1], b[2], -a[2], b[1]);
+		result.data[1] = mac2(a[2], b[0], -a[0], b[2]);
+		result.data[2] = mac2(a[0], b[1], -a[1], b[0]);
+		return result;
+	}
+
+	// Hamilton product of 1x4 quaternions, as Matrix::quaternion_multiply
+	BasicMatrix quaternion_multiply(const BasicMatrix& rhs) const {
+		if (m != 1 || n != 4 || rhs.m != 1 || rhs.n != 4)
+			return BasicMatrix(0, 0);
+		BasicMatrix result(1, 4);
+		hamilton(data, rhs.data, result.data);
+		return result;
+	}
+
+	// conjugate over the squared norm; a plain conjugate for unit quaternions
+	// in fixed point, where the squared norm rounds to the top of the range
+	BasicMatrix quaternion_inverse() const {
+		if (m != 1 || n != 4)
+			return BasicMatrix(0, 0);
+		Accumulator acc = Accumulator();
+		for (int i=0; i<4; i++)
+			Traits::mac(acc, data[i], data[i]);
+		T s = Traits::round(acc);
+		BasicMatrix result(1, 4);
+		result.data[0] = data[0] / s;
+		for (int i=1; i<4; i++)
+			result.data[i] = -data[i] / s;
+		return result;
+	}
+
+	// rotates this 1x3 vector by Q as Q * (0, v) * Q^-1. Two Hamilton
+	// products rather than the closed form of Matrix::quaternion_rotate,
+	// so every intermediate stays within |Q|^2 |v| and fits fixed point.
+	BasicMatrix quaternion_rotate(const BasicMatrix& Q, bool unit=false) const {
+		if (m != 1 || n != 3 || Q.m != 1 || Q.n != 4)
+			return BasicMatrix(0, 0);
+		T v[4] = {T(), data[0], data[1], data[2]};
+		T inv[4];
+		if (unit) {
+			inv[0] = Q.data[0];
+			for (int i=1; i<4; i++)
+				inv[i] = -Q.data[i];
+		} else {
+			BasicMatrix qi = Q.quaternion_inverse();
+			for (int i=0; i<4; i++)
+				inv[i] = qi.data[i];
+		}
+		T qv[4], r[4];
+		hamilton(Q.data, v, qv);
+		hamilton(qv, inv, r);
+		BasicMatrix result(1, 3);
+		for (int i=0; i<3; i++)
+			result.data[i] = r[i + 1];
+		return result;
+	}
+
+	void release() {
+		if (isAllocated)
+			delete[] data;
+		data = 0;
+		isAllocated = false;
+		m = 0;
+		n = 0;
+	}
+
+	T* data;
+	mdim_t m;
+	mdim_t n;
+	bool isAllocated;
+
+private:
+	void allocate() {
+		if (isAllocated)
+			delete[] data;
+		data = size() ? new T[size()] : 0;
+		isAllocated = data != 0;
+		for (msize_t k=0; k<size(); k++)
+			data[k] = T();
+	}
+	static T mac2(T a, T b, T c, T d) {
+		Accumulator acc = Accumulator();
+		Traits::mac(acc, a, b);
+		Traits::mac(acc, c, d);
+		return Traits::round(acc);
+	}
+	static T mac4(T a0, T b0, T a1, T b1, T a2, T b2, T a3, T b3) {
+		Accumulator acc = Accumulator();
+		Traits::mac(acc, a0, b0);
+		Traits::mac(acc, a1, b1);
+		Traits::mac(acc, a2, b2);
+		Traits::mac(acc, a3, b3);
+		return Traits::round(acc);
+	}
+	static void hamilton(const T* a, const T* b, T* r) {
+		r[0] = mac4(a[0], b[0], -a[1], b[1], -a[2], b[2], -a[3], b[3]);
+		r[1] = mac4(a[0], b[1], a[1], b[0], a[2], b[3], -a[3], b[2]);
+		r[2] = mac4(a[0], b[2], -a[1], b[3], a[2], b[0], a[3], b[1]);
+		r[3] = mac4(a[0], b[3], a[1], b[2], -a[2], b[1], a[3], b[0]);
+	}
+};
+
+typedef BasicMatrix<float> MatrixF;
+typedef BasicMatrix<double> MatrixD;
+typedef BasicMatrix<Q15> MatrixQ15;
+typedef BasicMatrix<Q31> MatrixQ31;
+
+#endif /* BASICMATRIX_H_ */
@@ -0,0 +1,228 @@
+#include "Cholesky.h"
+#include <math.h>
+
+Cholesky::Cholesky() {
+	ok = false;
+}
+
+Cholesky::Cholesky(const Matrix& A) {
+	ok = false;
+	factor(A);
+}
+
+bool Cholesky::factor(const Matrix& A) {
+	ok = false;
+	if (A.m != A.n)
+		return false;
+	L = A;
+	ok = factorInPlace(L);
+	return ok;
+}
+
+bool Cholesky::factorInPlace(Matrix& A) {
+	if (A.m != A.n)
+		return false;
+	mdim_t n = A.n;
+	for (mdim_t j=0; j<n; j++) {
+		double d = A.get(j, j);
+		for (mdim_t k=0; k<j; k++)
+			d -= A.get(j, k) * A.get(j, k);
+		if (!(d > 0.0)) // also catches NaN
+			return false;
+		d = sqrt(d);
+		A.set(j, j) = d;
+		double inv = 1.0 / d;
+		for (mdim_t i=j+1; i<n; i++) {
+			double s = A.get(i, j);
+			for (mdim_t k=0; k<j; k++)
+				s -= A.get(i, k) * A.get(j, k);
+			A.set(i, j) = s * inv;
+			A.set(j, i) = 0.0;
+		}
+	}
+	return true;
+}
+
+bool Cholesky::isPositiveDefinite() const {
+	return ok;
+}
+
+Matrix& Cholesky::solveLower(const Matrix& L, Matrix& b) {
+	mdim_t n = L.n;
+	for (mdim_t c=0; c<b.n; c++)
+		for (mdim_t i=0; i<n; i++) {
+			double acc = b.get(i, c);
+			for (mdim_t k=0; k<i; k++)
+				acc -= L.get(i, k) * b.get(k, c);
+			b.set(i, c) = acc / L.get(i, i);
+		}
+	return b;
+}
+
+Matrix& Cholesky::solveLowerTransposed(const Matrix& L, Matrix& b) {
+	mdim_t n = L.n;
+	for (mdim_t c=0; c<b.n; c++)
+		for (mdim_t i=n; i-- > 0; ) {
+			double acc = b.get(i, c);
+			for (mdim_t k=i+1; k<n; k++)
+				acc -= L.get(k, i) * b.get(k, c);
+			b.set(i, c) = acc / L.get(i, i);
+		}
+	return b;
+}
+
+Matrix& Cholesky::solveInPlace(Matrix& b) const {
+	if (!ok || b.m != L.n)
+		return b;
+	solveLower(L, b);
+	return solveLowerTransposed(L, b);
+}
+
+Matrix Cholesky::solve(const Matrix& b) const {
+	if (!ok || b.m != L.n)
+		return Matrix();
+	Matrix x(b);
+	solveInPlace(x);
+	return x;
+}
+
+bool Cholesky::rankUpdate(const Matrix& x, double sigma) {
+	mdim_t n = L.n;
+	bool column = x.n == 1;
+	if (!ok || (column ? x.m : x.n) != n || (!column && x.m != 1))
+		return false;
+	Matrix w(x);
+	double scale = sqrt(fabs(sigma));
+	bool downdate = sigma < 0.0;
+	for (mdim_t k=0; k<n; k++) {
+		double& wk = column ? w(k, 0) : w(0, k);
+		wk *= scale;
+	}
+
+	for (mdim_t k=0; k<n; k++) {
+		double lkk = L.get(k, k);
+		double wk = column ? w.get(k, 0) : w.get(0, k);
+		double r2 = downdate ? lkk * lkk - wk * wk : lkk * lkk + wk * wk;
+		if (!(r2 > 0.0)) {
+			ok = false;
+			return false;
+		}
+		double r = sqrt(r2);
+		double c = r / lkk;
+		double s = wk / lkk;
+		L.set(k, k) = r;
+		for (mdim_t i=k+1; i<n; i++) {
+			double& wi = column ? w(i, 0) : w(0, i);
+			double lik = L.get(i, k);
+			lik = downdate ? (lik - s * wi) / c : (lik + s * wi) / c;
+			L.set(i, k) = lik;
+			wi = c * wi - s * lik;
+		}
+	}
+	return true;
+}
+
+double Cholesky::determinant() const {
+	if (!ok)
+		return 0.0;
+	double result = 1.0;
+	for (mdim_t i=0; i<L.n; i++)
+		result *= L.get(i, i);
+	return result * result;
+}
+
+Matrix Cholesky::inverse() const {
+	if (!ok)
+		return Matrix();
+	Matrix result = Matrix::identity(L.n);
+	solveInPlace(result);
+	return result;
+}
+
+LDLT::LDLT() {
+	ok = false;
+}
+
+LDLT::LDLT(const Matrix& A, double tolerance) {
+	ok = false;
+	factor(A, tolerance);
+}
+
+bool LDLT::factor(const Matrix& A, double tolerance) {
+	ok = false;
+	if (A.m != A.n)
+		return false;
+	mdim_t n = A.n;
+	LD = A;
+
+	double scale = 0.0;
+	for (mdim_t i=0; i<n; i++)
+		if (fabs(A.get(i, i)) > scale)
+			scale = fabs(A.get(i, i));
+	double eps = tolerance * (scale > 0.0 ? scale : 1.0);
+
+	for (mdim_t j=0; j<n; j++) {
+		double d = LD.get(j, j);
+		for (mdim_t k=0; k<j; k++)
+			d -= LD.get(j, k) * LD.get(j, k) * LD.get(k, k);
+		if (d < -eps)
+			return false;
+		if (d <= eps)
+			d = 0.0;
+		LD.set(j, j) = d;
+		for (mdim_t i=j+1; i<n; i++) {
+			double s = LD.get(i, j);
+			for (mdim_t k=0; k<j; k++)
+				s -= LD.get(i, k) * LD.get(j, k) * LD.get(k, k);
+			LD.set(i, j) = d == 0.0 ? 0.0 : s / d;
+			LD.set(j, i) = 0.0;
+		}
+	}
+	ok = true;
+	return true;
+}
+
+bool LDLT::isPositiveSemidefinite() const {
+	return ok;
+}
+
+mdim_t LDLT::rank() const {
+	mdim_t result = 0;
+	for (mdim_t i=0; ok && i<LD.n; i++)
+		if (LD.get(i, i) != 0.0)
+			result++;
+	return result;
+}
+
+Matrix& LDLT::solveInPlace(Matrix& b) const {
+	mdim_t n = LD.n;
+	if (!ok || b.m != n)
+		return b;
+	for (mdim_t c=0; c<b.n; c++) {
+		for (mdim_t i=0; i<n; i++) {
+			double acc = b.get(i, c);
+			for (mdim_t k=0; k<i; k++)
+				acc -= LD.get(i, k) * b.get(k, c);
+			b.set(i, c) = acc;
+		}
+		for (mdim_t i=0; i<n; i++) {
+			double d = LD.get(i, i);
+			b.set(i, c) = d == 0.0 ? 0.0 : b.get(i, c) / d;
+		}
+		for (mdim_t i=n; i-- > 0; ) {
+			double acc = b.get(i, c);
+			for (mdim_t k=i+1; k<n; k++)
+				acc -= LD.get(k, i) * b.get(k, c);
+			b.set(i, c) = acc;
+		}
+	}
+	return b;
+}
+
+Matrix LDLT::solve(const Matrix& b) const {
+	if (!ok || b.m != LD.n)
+		return Matrix();
+	Matrix x(b);
+	solveInPlace(x);
+	return x;
+}
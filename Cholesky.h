@@ -0,0 +1,62 @@
+#ifndef CHOLESKY_H_
+#define CHOLESKY_H_
+
+#include "Matrix.h"
+
+// Cholesky factorization A = L * L^T of a symmetric positive-definite
+// matrix. Only the lower triangle of A is read. Needs no pivot search and
+// half the work of LU; factor() stops at the first non-positive pivot and
+// returns false, so it doubles as a cheap SPD test.
+class Cholesky {
+public:
+	Cholesky();
+	Cholesky(const Matrix& A);
+
+	bool factor(const Matrix& A);
+	// overwrites A with L (upper triangle zeroed), no allocation
+	static bool factorInPlace(Matrix& A);
+	bool isPositiveDefinite() const;
+
+	// solves A * x = b column by column, returns an empty matrix on failure
+	Matrix solve(const Matrix& b) const;
+	Matrix& solveInPlace(Matrix& b) const;
+
+	// L * y = b and L^T * x = y for a lower triangular L, in place
+	static Matrix& solveLower(const Matrix& L, Matrix& b);
+	static Matrix& solveLowerTransposed(const Matrix& L, Matrix& b);
+
+	// A + sigma * x * x^T for a vector x (n x 1 or 1 x n), O(n^2).
+	// A downdate (sigma < 0) that would lose definiteness returns false
+	// and leaves the factor unusable.
+	bool rankUpdate(const Matrix& x, double sigma=1.0);
+
+	double determinant() const;
+	Matrix inverse() const;
+
+	Matrix L;
+	bool ok;
+};
+
+// A = L * D * L^T with unit lower triangular L and diagonal D, for
+// symmetric positive semi-definite matrices. Pivots within tolerance of
+// zero are accepted (the matching solution components are set to zero);
+// a clearly negative pivot means A is indefinite and factor() fails.
+class LDLT {
+public:
+	LDLT();
+	LDLT(const Matrix& A, double tolerance=1.0e-12);
+
+	bool factor(const Matrix& A, double tolerance=1.0e-12);
+	bool isPositiveSemidefinite() const;
+	// number of non-zero pivots
+	mdim_t rank() const;
+
+	Matrix solve(const Matrix& b) const;
+	Matrix& solveInPlace(Matrix& b) const;
+
+	// strictly lower part holds L, the diagonal holds D
+	Matrix LD;
+	bool ok;
+};
+
+#endif /* CHOLESKY_H_ */
@@ -0,0 +1,257 @@
+#ifndef FIXEDMATRIX_H_
+#define FIXEDMATRIX_H_
+
+#include "Matrix.h"
+#include <math.h>
+
+// Compile-time unrolled loop: calls f(0) .. f(N-1).
+template<int N>
+struct FixedUnroll {
+	template<typename F>
+	static inline void run(F& f) {
+		FixedUnroll<N-1>::run(f);
+		f(N-1);
+	}
+};
+
+template<>
+struct FixedUnroll<0> {
+	template<typename F>
+	static inline void run(F&) {}
+};
+
+// Fixed-size M x N matrix with inline (stack) storage, always row-major.
+// Dimensions are checked at compile time, nothing here touches the heap.
+template<int M, int N>
+class FixedMatrix {
+public:
+	enum { rows = M, cols = N, size = M * N };
+
+	FixedMatrix() {
+		for (int i=0; i<size; i++)
+			data[i] = 0.0;
+	}
+	explicit FixedMatrix(const double* values) {
+		copyData(values);
+	}
+	// from a dynamic Matrix; on shape mismatch the result stays zero
+	explicit FixedMatrix(const Matrix& rhs) {
+		for (int i=0; i<size; i++)
+			data[i] = 0.0;
+		if (rhs.m == M && rhs.n == N)
+			for (int i=0; i<M; i++)
+				for (int j=0; j<N; j++)
+					data[i * N + j] = rhs.get(i, j);
+	}
+
+	static FixedMatrix identity() {
+		static_assert(M == N, "identity requires a square matrix");
+		FixedMatrix result;
+		for (int i=0; i<M; i++)
+			result.data[i * N + i] = 1.0;
+		return result;
+	}
+
+	FixedMatrix& copyData(const double* values) {
+		for (int i=0; i<size; i++)
+			data[i] = values[i];
+		return *this;
+	}
+
+	double& operator()(int i, int j=0) { return data[i * N + j]; }
+	const double& operator()(int i, int j=0) const { return data[i * N + j]; }
+	const double& get(int i, int j) const { return data[i * N + j]; }
+	double& set(int i, int j) { return data[i * N + j]; }
+
+	// owning copy as a dynamic Matrix
+	Matrix toMatrix() const {
+		Matrix result(M, N);
+		result.copyData(data);
+		return result;
+	}
+	// non-owning alias, do not use after this FixedMatrix is gone
+	Matrix asMatrix() {
+		return Matrix(M, N, data);
+	}
+
+	FixedMatrix& operator+=(const FixedMatrix& rhs) {
+		Add op = {data, rhs.data};
+		FixedUnroll<size>::run(op);
+		return *this;
+	}
+	FixedMatrix& operator-=(const FixedMatrix& rhs) {
+		Sub op = {data, rhs.data};
+		FixedUnroll<size>::run(op);
+		return *this;
+	}
+	FixedMatrix& operator*=(double scalar) {
+		Scale op = {data, scalar};
+		FixedUnroll<size>::run(op);
+		return *this;
+	}
+	FixedMatrix& multiplySelf(const FixedMatrix& rhs) {
+		Mul op = {data, rhs.data};
+		FixedUnroll<size>::run(op);
+		return *this;
+	}
+
+	FixedMatrix operator+(const FixedMatrix& rhs) const { FixedMatrix r(*this); return r += rhs; }
+	FixedMatrix operator-(const FixedMatrix& rhs) const { FixedMatrix r(*this); return r -= rhs; }
+	FixedMatrix operator-() const { FixedMatrix r(*this); return r *= -1.0; }
+	FixedMatrix operator*(double scalar) const { FixedMatrix r(*this); return r *= scalar; }
+	FixedMatrix multiply(const FixedMatrix& rhs) const { FixedMatrix r(*this); return r.multiplySelf(rhs); }
+
+	bool operator==(const FixedMatrix& other) const {
+		for (int i=0; i<size; i++)
+			if (data[i] != other.data[i])
+				return false;
+		return true;
+	}
+	bool operator!=(const FixedMatrix& other) const { return !(*this == other); }
+
+	template<int P>
+	FixedMatrix<M, P> dot(const FixedMatrix<N, P>& rhs) const {
+		FixedMatrix<M, P> result;
+		Dot<P> op = {data, rhs.data, result.data};
+		FixedUnroll<M * P>::run(op);
+		return result;
+	}
+
+	FixedMatrix<N, M> transposed() const {
+		FixedMatrix<N, M> result;
+		Transpose op = {data, result.data};
+		FixedUnroll<size>::run(op);
+		return result;
+	}
+
+	FixedMatrix cross(const FixedMatrix& rhs) const {
+		static_assert(M == 1 && N == 3, "cross is defined for 1x3 row vectors only");
+		FixedMatrix result;
+		result.data[0] = data[1] * rhs.data[2] - data[2] * rhs.data[1];
+		result.data[1] = data[2] * rhs.data[0] - data[0] * rhs.data[2];
+		result.data[2] = data[0] * rhs.data[1] - data[1] * rhs.data[0];
+		return result;
+	}
+
+	// Hamilton product, same convention as Matrix::quaternion_multiply
+	FixedMatrix quaternion_multiply(const FixedMatrix& rhs) const {
+		static_assert(M == 1 && N == 4, "quaternion_multiply is defined for 1x4 row vectors only");
+		const double* a = data;
+		const double* b = rhs.data;
+		FixedMatrix result;
+		result.data[0] = a[0]*b[0] - a[1]*b[1] - a[2]*b[2] - a[3]*b[3];
+		result.data[1] = a[0]*b[1] + a[1]*b[0] + a[2]*b[3] - a[3]*b[2];
+		result.data[2] = a[0]*b[2] - a[1]*b[3] + a[2]*b[0] + a[3]*b[1];
+		result.data[3] = a[0]*b[3] + a[1]*b[2] - a[2]*b[1] + a[3]*b[0];
+		return result;
+	}
+
+	FixedMatrix quaternion_inverse() const {
+		static_assert(M == 1 && N == 4, "quaternion_inverse is defined for 1x4 row vectors only");
+		double sqr_norm_inv = 1.0/(data[0]*data[0] + data[1]*data[1] + data[2]*data[2] + data[3]*data[3]);
+		FixedMatrix result;
+		result.data[0] =  data[0] * sqr_norm_inv;
+		result.data[1] = -data[1] * sqr_norm_inv;
+		result.data[2] = -data[2] * sqr_norm_inv;
+		result.data[3] = -data[3] * sqr_norm_inv;
+		return result;
+	}
+
+	// rotates this 1x3 vector by quaternion Q: Q * v * Q^-1,
+	// see Matrix::quaternion_rotate for the unit flag
+	FixedMatrix quaternion_rotate(const FixedMatrix<1, 4>& Q, bool unit=false) const {
+		static_assert(M == 1 && N == 3, "quaternion_rotate is defined for 1x3 row vectors only");
+		const double* q = Q.data;
+		const double* v = data;
+		double tx = 2.0 * (q[2]*v[2] - q[3]*v[1]);
+		double ty = 2.0 * (q[3]*v[0] - q[1]*v[2]);
+		double tz = 2.0 * (q[1]*v[1] - q[2]*v[0]);
+		FixedMatrix result;
+		if (unit) {
+			result.data[0] = v[0] + q[0]*tx + (q[2]*tz - q[3]*ty);
+			result.data[1] = v[1] + q[0]*ty + (q[3]*tx - q[1]*tz);
+			result.data[2] = v[2] + q[0]*tz + (q[1]*ty - q[2]*tx);
+		} else {
+			double qq = q[1]*q[1] + q[2]*q[2] + q[3]*q[3];
+			double inv = 1.0 / (q[0]*q[0] + qq);
+			double s = q[0]*q[0] - qq;
+			double d2 = 2.0 * (q[1]*v[0] + q[2]*v[1] + q[3]*v[2]);
+			result.data[0] = (s*v[0] + d2*q[1] + q[0]*tx) * inv;
+			result.data[1] = (s*v[1] + d2*q[2] + q[0]*ty) * inv;
+			result.data[2] = (s*v[2] + d2*q[3] + q[0]*tz) * inv;
+		}
+		return result;
+	}
+
+	FixedMatrix& normalize() {
+		double k = norm();
+		if (k > 0) {
+			*this *= (1 / k);
+		}
+		return *this;
+	}
+
+	double norm() const {
+		return sqrt(sumSquares());
+	}
+
+	double sum() const {
+		double result = 0.0;
+		for (int i=0; i<size; i++)
+			result += data[i];
+		return result;
+	}
+
+	double trace() const {
+		double result = 0.0;
+		for (int i=0; i<M && i<N; i++)
+			result += data[i * N + i];
+		return result;
+	}
+
+	bool closeEnough(const FixedMatrix& another) const {
+		for (int i=0; i<size; i++)
+			if (fabs(data[i] - another.data[i]) > 1.0e-6)
+				return false;
+		return true;
+	}
+
+	double data[M * N];
+
+private:
+	double sumSquares() const {
+		double result = 0.0;
+		for (int i=0; i<size; i++)
+			result += data[i] * data[i];
+		return result;
+	}
+
+	struct Add { double* a; const double* b; inline void operator()(int i) { a[i] += b[i]; } };
+	struct Sub { double* a; const double* b; inline void operator()(int i) { a[i] -= b[i]; } };
+	struct Mul { double* a; const double* b; inline void operator()(int i) { a[i] *= b[i]; } };
+	struct Scale { double* a; double s; inline void operator()(int i) { a[i] *= s; } };
+	struct Transpose {
+		const double* a; double* r;
+		inline void operator()(int idx) { r[(idx % N) * M + idx / N] = a[idx]; }
+	};
+	template<int P>
+	struct Dot {
+		const double* a; const double* b; double* r;
+		inline void operator()(int idx) {
+			Row op = {a + (idx / P) * N, b + idx % P, 0.0};
+			FixedUnroll<N>::run(op);
+			r[idx] = op.acc;
+		}
+		struct Row {
+			const double* a; const double* b; double acc;
+			inline void operator()(int k) { acc += a[k] * b[k * P]; }
+		};
+	};
+};
+
+typedef FixedMatrix<1, 3> FixedVector3;
+typedef FixedMatrix<1, 4> FixedQuaternion;
+typedef FixedMatrix<3, 3> FixedMatrix3;
+typedef FixedMatrix<4, 4> FixedMatrix4;
+
+#endif /* FIXEDMATRIX_H_ */
@@ -0,0 +1,144 @@
+#ifndef FIXEDPOINT_H_
+#define FIXEDPOINT_H_
+
+#include <math.h>
+#include <stdint.h>
+
+// Q-format fixed point: a signed Raw integer with F fractional bits, so
+// Q15 covers [-1, 1) in steps of 2^-15 and Q31 in steps of 2^-31. Every
+// operation saturates instead of wrapping. Meant for MCUs without an FPU,
+// where these are a few integer instructions against a software double.
+//
+// Sums of products are formed in a 64-bit Accumulator holding the exact
+// product shifted right by Shift (2F - Shift fractional bits): Q15 keeps
+// Q30 products with 2^33 terms of headroom, Q31 drops 14 bits to Q48 and
+// still has 2^15. mac() saturates as well, round() narrows back to Q.
+template<typename Raw, int F, int Shift>
+class QFixed {
+public:
+	typedef int64_t Accumulator;
+	enum { fractionBits = F };
+
+	QFixed() : raw(0) {}
+	QFixed(double value) : raw(saturate(floor(value * scale() + 0.5))) {}
+	static QFixed fromRaw(Raw r) { QFixed q; q.raw = r; return q; }
+	static QFixed max() { return fromRaw(rawMax()); }
+	static QFixed min() { return fromRaw(rawMin()); }
+	double toDouble() const { return raw / scale(); }
+
+	QFixed operator+(QFixed rhs) const { return fromRaw(saturate((int64_t)raw + rhs.raw)); }
+	QFixed operator-(QFixed rhs) const { return fromRaw(saturate((int64_t)raw - rhs.raw)); }
+	QFixed operator-() const { return fromRaw(saturate(-(int64_t)raw)); }
+	// rounded to nearest
+	QFixed operator*(QFixed rhs) const {
+		return fromRaw(saturate(((int64_t)raw * rhs.raw + ((int64_t)1 << (F - 1))) >> F));
+	}
+	// saturates for |this| >= |rhs|, and for a zero divisor
+	QFixed operator/(QFixed rhs) const {
+		if (rhs.raw == 0)
+			return raw < 0 ? min() : max();
+		return fromRaw(saturate((int64_t)raw * ((int64_t)1 << F) / rhs.raw));
+	}
+	QFixed& operator+=(QFixed rhs) { return *this = *this + rhs; }
+	QFixed& operator-=(QFixed rhs) { return *this = *this - rhs; }
+	QFixed& operator*=(QFixed rhs) { return *this = *this * rhs; }
+	QFixed& operator/=(QFixed rhs) { return *this = *this / rhs; }
+
+	bool operator==(QFixed rhs) const { return raw == rhs.raw; }
+	bool operator!=(QFixed rhs) const { return raw != rhs.raw; }
+	bool operator<(QFixed rhs) const { return raw < rhs.raw; }
+	bool operator>(QFixed rhs) const { return raw > rhs.raw; }
+	bool operator<=(QFixed rhs) const { return raw <= rhs.raw; }
+	bool operator>=(QFixed rhs) const { return raw >= rhs.raw; }
+
+	// acc += a * b, saturating
+	static void mac(Accumulator& acc, QFixed a, QFixed b) {
+		int64_t p = ((int64_t)a.raw * b.raw) >> Shift;
+		if (p > 0 && acc > INT64_MAX - p)
+			acc = INT64_MAX;
+		else if (p < 0 && acc < INT64_MIN - p)
+			acc = INT64_MIN;
+		else
+			acc += p;
+	}
+	// rounds an accumulator back to Q, saturating
+	static QFixed round(Accumulator acc) {
+		const int s = F - Shift;
+		if (acc > INT64_MAX - ((int64_t)1 << (s - 1)))
+			return max();
+		return fromRaw(saturate((acc + ((int64_t)1 << (s - 1))) >> s));
+	}
+	// square root of an accumulated sum of squares, no floating point
+	static QFixed sqrt(Accumulator acc) {
+		if (acc <= 0)
+			return QFixed();
+		// the root of a value with 2F - Shift fractional bits has F - Shift / 2;
+		// shift up first when there is room, to keep the low bits
+		if (acc <= (INT64_MAX >> Shift))
+			return fromRaw(saturate((int64_t)isqrt((uint64_t)acc << Shift)));
+		return fromRaw(saturate((int64_t)isqrt((uint64_t)acc) << (Shift / 2)));
+	}
+	static QFixed abs(QFixed v) { return v.raw < 0 ? -v : v; }
+
+	Raw raw;
+
+private:
+	static double scale() { return (double)((int64_t)1 << F); }
+	static int64_t rawMax() { return ((int64_t)1 << (sizeof(Raw) * 8 - 1)) - 1; }
+	static int64_t rawMin() { return -((int64_t)1 << (sizeof(Raw) * 8 - 1)); }
+	static Raw saturate(int64_t v) {
+		return (Raw)(v > rawMax() ? rawMax() : v < rawMin() ? rawMin() : v);
+	}
+	static Raw saturate(double v) {
+		return (Raw)(v > (double)rawMax() ? rawMax() : v < (double)rawMin() ? rawMin() : (int64_t)v);
+	}
+	// floor(sqrt(v)), bit by bit
+	static uint64_t isqrt(uint64_t v) {
+		uint64_t result = 0;
+		uint64_t bit = (uint64_t)1 << 62;
+		while (bit > v)
+			bit >>= 2;
+		while (bit) {
+			if (v >= result + bit) {
+				v -= result + bit;
+				result = (result >> 1) + bit;
+			} else
+				result >>= 1;
+			bit >>= 2;
+		}
+		return result;
+	}
+};
+
+typedef QFixed<int16_t, 15, 0> Q15;
+typedef QFixed<int32_t, 31, 14> Q31;
+
+// What the generic kernels need from an element type: an accumulator for
+// sums of products, conversion from and to double, and a square root.
+template<typename T>
+struct ScalarTraits {
+	// double and float: plain arithmetic, accumulating in T
+	typedef T Accumulator;
+	enum { floating = 1 };
+	static T fromDouble(double v) { return (T)v; }
+	static double toDouble(T v) { return v; }
+	static void mac(Accumulator& acc, T a, T b) { acc += a * b; }
+	static T round(Accumulator acc) { return acc; }
+	static T sqrt(Accumulator acc) { return (T)::sqrt(acc); }
+	static T abs(T v) { return v < 0 ? -v : v; }
+};
+
+template<typename Raw, int F, int Shift>
+struct ScalarTraits<QFixed<Raw, F, Shift> > {
+	typedef QFixed<Raw, F, Shift> T;
+	typedef typename T::Accumulator Accumulator;
+	enum { floating = 0 };
+	static T fromDouble(double v) { return T(v); }
+	static double toDouble(T v) { return v.toDouble(); }
+	static void mac(Accumulator& acc, T a, T b) { T::mac(acc, a, b); }
+	static T round(Accumulator acc) { return T::round(acc); }
+	static T sqrt(Accumulator acc) { return T::sqrt(acc); }
+	static T abs(T v) { return T::abs(v); }
+};
+
+#endif /* FIXEDPOINT_H_ */
@@ -0,0 +1,213 @@
+#include "Gemm.h"
+#include "MatrixSimd.h"
+#include "MatrixAllocator.h"
+#include "Parallel.h"
+#include <stddef.h>
+
+// register tile (MR x NR), NR is a multiple of every SIMD width
+#define GEMM_MR 4
+#define GEMM_NR 8
+// cache blocks: an MC x KC panel of A stays in L2, a KC x NR sliver of B in L1
+#define GEMM_MC 64
+#define GEMM_KC 256
+#define GEMM_NC 1024
+
+// the register tile only stays in registers once these loops are unrolled,
+// which -O2/-Os do not do on their own
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 8
+#define GEMM_UNROLL _Pragma("GCC unroll 16")
+#else
+#define GEMM_UNROLL
+#endif
+
+static inline unsigned int min_u(unsigned int a, unsigned int b) {
+	return a < b ? a : b;
+}
+
+// packs an mc x kc block of A into MR-row panels, column by column, zero padded
+static void pack_a(unsigned int mc, unsigned int kc, const double* a, int rsa, int csa, double* packed) {
+	for (unsigned int p=0; p<mc; p+=GEMM_MR) {
+		unsigned int rows = min_u(GEMM_MR, mc - p);
+		for (unsigned int kk=0; kk<kc; kk++) {
+			const double* src = a + (ptrdiff_t)p * rsa + (ptrdiff_t)kk * csa;
+			for (unsigned int r=0; r<rows; r++)
+				packed[r] = src[(ptrdiff_t)r * rsa];
+			for (unsigned int r=rows; r<GEMM_MR; r++)
+				packed[r] = 0.0;
+			packed += GEMM_MR;
+		}
+	}
+}
+
+// packs a kc x nc block of B into NR-column panels, row by row, zero padded
+static void pack_b(unsigned int kc, unsigned int nc, const double* b, int rsb, int csb, double* packed) {
+	for (unsigned int q=0; q<nc; q+=GEMM_NR) {
+		unsigned int cols = min_u(GEMM_NR, nc - q);
+		for (unsigned int kk=0; kk<kc; kk++) {
+			const double* src = b + (ptrdiff_t)kk * rsb + (ptrdiff_t)q * csb;
+			for (unsigned int c=0; c<cols; c++)
+				packed[c] = src[(ptrdiff_t)c * csb];
+			for (unsigned int c=cols; c<GEMM_NR; c++)
+				packed[c] = 0.0;
+			packed += GEMM_NR;
+		}
+	}
+}
+
+// tile = a_panel * b_panel over kc, MR x NR, row-major
+static inline void micro_kernel(unsigned int kc, const double* a, const double* b, double* tile) {
+	enum { V = GEMM_NR / SIMD_WIDTH };
+	simd_d acc[GEMM_MR][V];
+	GEMM_UNROLL
+	for (int r=0; r<GEMM_MR; r++)
+		GEMM_UNROLL
+		for (int v=0; v<V; v++)
+			acc[r][v] = simd_set1(0.0);
+
+	for (unsigned int kk=0; kk<kc; kk++) {
+		simd_d bv[V];
+		GEMM_UNROLL
+		for (int v=0; v<V; v++)
+			bv[v] = simd_load(b + v * SIMD_WIDTH);
+		GEMM_UNROLL
+		for (int r=0; r<GEMM_MR; r++) {
+			simd_d av = simd_set1(a[r]);
+			GEMM_UNROLL
+			for (int v=0; v<V; v++)
+				acc[r][v] = simd_fmadd(av, bv[v], acc[r][v]);
+		}
+		a += GEMM_MR;
+		b += GEMM_NR;
+	}
+
+	GEMM_UNROLL
+	for (int r=0; r<GEMM_MR; r++)
+		GEMM_UNROLL
+		for (int v=0; v<V; v++)
+			simd_store(tile + r * GEMM_NR + v * SIMD_WIDTH, acc[r][v]);
+}
+
+// doubles of packing scratch gemm_serial needs for an m x n x k product
+static void pack_sizes(unsigned int m, unsigned int n, unsigned int k, size_t* sizeA, size_t* sizeB) {
+	unsigned int mcMax = min_u(GEMM_MC, (m + GEMM_MR - 1) / GEMM_MR * GEMM_MR);
+	unsigned int kcMax = min_u(GEMM_KC, k);
+	unsigned int ncMax = min_u(GEMM_NC, (n + GEMM_NR - 1) / GEMM_NR * GEMM_NR);
+	*sizeA = (size_t)mcMax * kcMax;
+	*sizeB = (size_t)kcMax * ncMax;
+}
+
+static void gemm_serial(unsigned int m, unsigned int n, unsigned int k, double alpha,
+		const double* a, int rsa, int csa,
+		const double* b, int rsb, int csb,
+		double beta, double* c, int rsc, int csc,
+		double* packedA, double* packedB) {
+	// apply beta once up front, every k block then accumulates into C
+	for (unsigned int i=0; i<m; i++)
+		for (unsigned int j=0; j<n; j++) {
+			double& cij = c[(ptrdiff_t)i * rsc + (ptrdiff_t)j * csc];
+			cij = beta == 0.0 ? 0.0 : cij * beta;
+		}
+	if (!k || alpha == 0.0)
+		return;
+
+	double tile[GEMM_MR * GEMM_NR];
+
+	for (unsigned int jc=0; jc<n; jc+=GEMM_NC) {
+		unsigned int nc = min_u(GEMM_NC, n - jc);
+		for (unsigned int pc=0; pc<k; pc+=GEMM_KC) {
+			unsigned int kc = min_u(GEMM_KC, k - pc);
+			pack_b(kc, nc, b + (ptrdiff_t)pc * rsb + (ptrdiff_t)jc * csb, rsb, csb, packedB);
+
+			for (unsigned int ic=0; ic<m; ic+=GEMM_MC) {
+				unsigned int mc = min_u(GEMM_MC, m - ic);
+				pack_a(mc, kc, a + (ptrdiff_t)ic * rsa + (ptrdiff_t)pc * csa, rsa, csa, packedA);
+
+				for (unsigned int jr=0; jr<nc; jr+=GEMM_NR) {
+					unsigned int cols = min_u(GEMM_NR, nc - jr);
+					for (unsigned int ir=0; ir<mc; ir+=GEMM_MR) {
+						unsigned int rows = min_u(GEMM_MR, mc - ir);
+						micro_kernel(kc, packedA + ir * kc, packedB + jr * kc, tile);
+
+						double* cblock = c + (ptrdiff_t)(ic + ir) * rsc + (ptrdiff_t)(jc + jr) * csc;
+						for (unsigned int r=0; r<rows; r++)
+							for (unsigned int col=0; col<cols; col++)
+								cblock[(ptrdiff_t)r * rsc + (ptrdiff_t)col * csc] += alpha * tile[r * GEMM_NR + col];
+					}
+				}
+			}
+		}
+	}
+
+}
+
+#ifdef MATRIX_PARALLEL
+// one horizontal (byRows) or vertical strip of C per chunk, each with its
+// own slice of the packing workspace
+struct GemmSplit {
+	unsigned int m, n, k;
+	double alpha, beta;
+	const double* a;
+	const double* b;
+	double* c;
+	int rsa, csa, rsb, csb, rsc, csc;
+	bool byRows;
+	unsigned int step;
+	double* workspace;
+	size_t sizeA, sizeB;
+};
+
+static void gemm_chunk(void* context, msize_t chunk) {
+	const GemmSplit& s = *(const GemmSplit*)context;
+	unsigned int start = chunk * s.step;
+	double* packedA = s.workspace + chunk * (s.sizeA + s.sizeB);
+	double* packedB = packedA + s.sizeA;
+	if (s.byRows)
+		gemm_serial(min_u(s.step, s.m - start), s.n, s.k, s.alpha,
+				s.a + (ptrdiff_t)start * s.rsa, s.rsa, s.csa, s.b, s.rsb, s.csb,
+				s.beta, s.c + (ptrdiff_t)start * s.rsc, s.rsc, s.csc, packedA, packedB);
+	else
+		gemm_serial(s.m, min_u(s.step, s.n - start), s.k, s.alpha,
+				s.a, s.rsa, s.csa, s.b + (ptrdiff_t)start * s.csb, s.rsb, s.csb,
+				s.beta, s.c + (ptrdiff_t)start * s.csc, s.rsc, s.csc, packedA, packedB);
+}
+#endif
+
+void gemm(unsigned int m, unsigned int n, unsigned int k, double alpha,
+		const double* a, int rsa, int csa,
+		const double* b, int rsb, int csb,
+		double beta, double* c, int rsc, int csc) {
+	if (!m || !n)
+		return;
+
+	// packing scratch comes from the current Matrix allocator (on this
+	// thread, also for the parallel split) so a pool or arena covers
+	// large products too
+	MatrixAllocator* allocator = MatrixAllocator::current();
+	size_t sizeA, sizeB;
+#ifdef MATRIX_PARALLEL
+	unsigned int threads = MatrixParallel::threads();
+	if (threads > 1 && (double)m * n * k >= MatrixParallel::dotThreshold) {
+		GemmSplit s = {m, n, k, alpha, beta, a, b, c, rsa, csa, rsb, csb, rsc, csc, m >= n, 0, 0, 0, 0};
+		// strips are whole register tiles so no chunk gets a ragged edge it doesn't need
+		unsigned int tileDim = s.byRows ? GEMM_MR : GEMM_NR;
+		unsigned int dim = s.byRows ? m : n;
+		s.step = (dim + threads - 1) / threads;
+		s.step = (s.step + tileDim - 1) / tileDim * tileDim;
+		msize_t chunks = (dim + s.step - 1) / s.step;
+		if (chunks > 1) {
+			pack_sizes(s.byRows ? s.step : m, s.byRows ? n : s.step, k, &s.sizeA, &s.sizeB);
+			size_t bytes = chunks * (s.sizeA + s.sizeB) * sizeof(double);
+			s.workspace = (double*)allocator->allocate(bytes);
+			MatrixParallel::run(chunks, gemm_chunk, &s);
+			allocator->release(s.workspace, bytes);
+			return;
+		}
+	}
+#endif
+	pack_sizes(m, n, k, &sizeA, &sizeB);
+	double* packedA = (double*)allocator->allocate(sizeA * sizeof(double));
+	double* packedB = (double*)allocator->allocate(sizeB * sizeof(double));
+	gemm_serial(m, n, k, alpha, a, rsa, csa, b, rsb, csb, beta, c, rsc, csc, packedA, packedB);
+	allocator->release(packedB, sizeB * sizeof(double));
+	allocator->release(packedA, sizeA * sizeof(double));
+}
@@ -0,0 +1,21 @@
+#ifndef GEMM_H_
+#define GEMM_H_
+
+// Matrix::dot and dotSelf hand products with at least this many
+// multiply-adds (rows * cols * inner) over to gemm().
+#ifndef MATRIX_GEMM_THRESHOLD
+#define MATRIX_GEMM_THRESHOLD 2048
+#endif
+
+// C = alpha * A * B + beta * C
+// A is m x k, B is k x n, C is m x n. Every operand is addressed as
+// p[i * rowStride + j * colStride], so lazily transposed matrices are
+// passed by swapping their strides. Packs A and B into cache-sized panels
+// and runs a register-blocked SIMD micro-kernel over them.
+// If beta is 0, C is not read.
+void gemm(unsigned int m, unsigned int n, unsigned int k, double alpha,
+		const double* a, int rsa, int csa,
+		const double* b, int rsb, int csb,
+		double beta, double* c, int rsc, int csc);
+
+#endif /* GEMM_H_ */
@@ -0,0 +1,180 @@
+#ifndef KALMANFILTER_H_
+#define KALMANFILTER_H_
+
+#include "FixedMatrix.h"
+#include <math.h>
+
+// Linear or extended Kalman filter with N states and M measurements, built
+// on FixedMatrix: the model, the covariance and all scratch space are
+// members, so predict() and update() never touch the heap.
+//
+// update() inverts nothing. The measurement noise R is whitened once with
+// its Cholesky factor (setMeasurementNoise), which makes the M components
+// independent, and they are then folded in one at a time as scalar updates.
+// Each scalar update uses the Joseph form, written out for a single row h:
+//    P = (I - k h) P (I - k h)^T + r k k^T
+//      = P - k (P h)^T - (P h) k^T + (h P h + r) k k^T
+// Only the lower triangle is computed and then mirrored, so P stays
+// exactly symmetric.
+//
+//    KalmanFilter<4, 2> kf;
+//    kf.F = ...; kf.Q = ...; kf.H = ...;
+//    kf.setMeasurementNoise(R);
+//    kf.predict();
+//    kf.update(z);
+//
+// Extended filter: set F and H to the Jacobians at the current state and
+// pass f(x) to predict(fx) and h(x) to update(z, hx).
+template<int N, int M>
+class KalmanFilter {
+public:
+	typedef FixedMatrix<N, 1> State;
+	typedef FixedMatrix<M, 1> Measurement;
+
+	// x = 0, P = F = I, Q = H = 0, R = I
+	KalmanFilter() : P(FixedMatrix<N, N>::identity()), F(FixedMatrix<N, N>::identity()),
+			L(FixedMatrix<M, M>::identity()) {}
+
+	// stores the Cholesky factor of R (only its lower triangle is read);
+	// returns false and keeps the previous R if R is not positive definite
+	bool setMeasurementNoise(const FixedMatrix<M, M>& R) {
+		FixedMatrix<M, M> c;
+		for (int j=0; j<M; j++) {
+			double d = R(j, j);
+			for (int k=0; k<j; k++)
+				d -= c(j, k) * c(j, k);
+			if (!(d > 0.0)) // also catches NaN
+				return false;
+			d = sqrt(d);
+			c(j, j) = d;
+			for (int i=j+1; i<M; i++) {
+				double s = R(i, j);
+				for (int k=0; k<j; k++)
+					s -= c(i, k) * c(j, k);
+				c(i, j) = s / d;
+			}
+		}
+		L = c;
+		return true;
+	}
+
+	// x = F x, P = F P F^T + Q
+	void predict() {
+		x0 = x;
+		for (int i=0; i<N; i++) {
+			double acc = 0.0;
+			for (int k=0; k<N; k++)
+				acc += F(i, k) * x0(k);
+			x(i) = acc;
+		}
+		propagate();
+	}
+
+	// extended: x = f(x) given by the caller, F holds the Jacobian of f
+	void predict(const State& fx) {
+		x = fx;
+		propagate();
+	}
+
+	// linear measurement z = H x + v
+	bool update(const Measurement& z) {
+		Measurement hx;
+		for (int i=0; i<M; i++) {
+			double acc = 0.0;
+			for (int k=0; k<N; k++)
+				acc += H(i, k) * x(k);
+			hx(i) = acc;
+		}
+		return update(z, hx);
+	}
+
+	// extended: hx = h(x) at the current state, H holds the Jacobian of h.
+	// Returns false if an innovation variance came out non-positive; the
+	// components before it have been applied, the rest are skipped.
+	bool update(const Measurement& z, const Measurement& hx) {
+		// y = L^-1 (z - hx) and Hw = L^-1 H by forward substitution
+		for (int i=0; i<M; i++) {
+			double yi = z(i) - hx(i);
+			for (int c=0; c<N; c++)
+				Hw(i, c) = H(i, c);
+			for (int k=0; k<i; k++) {
+				yi -= L(i, k) * y(k);
+				for (int c=0; c<N; c++)
+					Hw(i, c) -= L(i, k) * Hw(k, c);
+			}
+			double inv = 1.0 / L(i, i);
+			y(i) = yi * inv;
+			for (int c=0; c<N; c++)
+				Hw(i, c) *= inv;
+		}
+
+		// later components see the state already corrected by earlier ones
+		x0 = x;
+		for (int i=0; i<M; i++) {
+			const double* h = Hw.data + i * N;
+			double innovation = y(i);
+			for (int c=0; c<N; c++)
+				innovation -= h[c] * (x(c) - x0(c));
+			if (!updateScalar(h, innovation, 1.0))
+				return false;
+		}
+		return true;
+	}
+
+	// one scalar measurement with row h (N values), innovation z - h(x)
+	// and noise variance r
+	bool updateScalar(const double* h, double innovation, double r) {
+		double s = r;
+		for (int i=0; i<N; i++) {
+			double acc = 0.0;
+			for (int j=0; j<N; j++)
+				acc += P(i, j) * h[j];
+			ph(i) = acc;
+			s += h[i] * acc;
+		}
+		if (!(s > 0.0))
+			return false;
+		double inv = 1.0 / s;
+		for (int i=0; i<N; i++) {
+			gain(i) = ph(i) * inv;
+			x(i) += gain(i) * innovation;
+		}
+		for (int i=0; i<N; i++)
+			for (int j=0; j<=i; j++)
+				P(i, j) = P(j, i) = P(i, j) - gain(i) * ph(j) - ph(i) * gain(j) + s * gain(i) * gain(j);
+		return true;
+	}
+
+	State x;
+	FixedMatrix<N, N> P;
+	FixedMatrix<N, N> F;
+	FixedMatrix<N, N> Q;
+	FixedMatrix<M, N> H;
+
+private:
+	// P = F P F^T + Q, lower triangle mirrored
+	void propagate() {
+		for (int i=0; i<N; i++)
+			for (int j=0; j<N; j++) {
+				double acc = 0.0;
+				for (int k=0; k<N; k++)
+					acc += F(i, k) * P(k, j);
+				FP(i, j) = acc;
+			}
+		for (int i=0; i<N; i++)
+			for (int j=0; j<=i; j++) {
+				double acc = Q(i, j);
+				for (int k=0; k<N; k++)
+					acc += FP(i, k) * F(j, k);
+				P(i, j) = P(j, i) = acc;
+			}
+	}
+
+	FixedMatrix<M, M> L;  // Cholesky factor of R
+	FixedMatrix<N, N> FP;
+	FixedMatrix<M, N> Hw; // whitened H
+	Measurement y;        // whitened innovation
+	State x0, ph, gain;
+};
+
+#endif /* KALMANFILTER_H_ */
@@ -0,0 +1,165 @@
+#include "LU.h"
+#include <math.h>
+
+LU::LU() {
+	pivots = 0;
+	sign = 1;
+	singular = true;
+	ownsPivots = true;
+}
+
+LU::LU(const Matrix& A) {
+	pivots = 0;
+	sign = 1;
+	singular = true;
+	ownsPivots = true;
+	factor(A);
+}
+
+LU::LU(mdim_t n, double* workspace, mdim_t* pivots) : lu(n, n, workspace) {
+	this->pivots = pivots;
+	sign = 1;
+	singular = true;
+	ownsPivots = false;
+}
+
+LU::~LU() {
+	if (ownsPivots)
+		delete[] pivots;
+}
+
+bool LU::factor(const Matrix& A) {
+	singular = true;
+	if (A.m != A.n)
+		return false;
+	mdim_t n = A.n;
+
+	if (lu.m != n || lu.n != n) {
+		if (!ownsPivots) // caller-provided storage has a fixed size
+			return false;
+		lu = Matrix(n, n);
+		delete[] pivots;
+		pivots = new mdim_t[n];
+	}
+	lu.isTransposed = false;
+	double* a = lu.data;
+	for (mdim_t i=0; i<n; i++)
+		for (mdim_t j=0; j<n; j++)
+			a[(msize_t)i * n + j] = A.get(i, j);
+
+	sign = 1;
+	for (mdim_t k=0; k<n; k++) {
+		// pivot: the row with the biggest entry in column k
+		mdim_t pivrow = k;
+		double best = fabs(a[(msize_t)k * n + k]);
+		for (mdim_t i=k+1; i<n; i++) {
+			double v = fabs(a[(msize_t)i * n + k]);
+			if (v > best) {
+				best = v;
+				pivrow = i;
+			}
+		}
+		pivots[k] = pivrow;
+		if (best == 0.0)
+			return false;
+
+		if (pivrow != k) {
+			double* rk = a + (msize_t)k * n;
+			double* rp = a + (msize_t)pivrow * n;
+			for (mdim_t j=0; j<n; j++) {
+				double tmp = rk[j];
+				rk[j] = rp[j];
+				rp[j] = tmp;
+			}
+			sign = -sign;
+		}
+
+		const double* rk = a + (msize_t)k * n;
+		double inv = 1.0 / rk[k];
+		for (mdim_t i=k+1; i<n; i++) {
+			double* ri = a + (msize_t)i * n;
+			double l = ri[k] * inv;
+			ri[k] = l;
+			if (l != 0.0)
+				for (mdim_t j=k+1; j<n; j++)
+					ri[j] -= l * rk[j];
+		}
+	}
+	singular = false;
+	return true;
+}
+
+bool LU::isSingular() const {
+	return singular;
+}
+
+Matrix& LU::solveInPlace(Matrix& b) const {
+	mdim_t n = lu.n;
+	if (singular || b.m != n)
+		return b;
+	const double* a = lu.data;
+
+	for (mdim_t c=0; c<b.n; c++) {
+		// apply the row swaps in the order they were made
+		for (mdim_t k=0; k<n; k++)
+			if (pivots[k] != k) {
+				double tmp = b.get(k, c);
+				b.set(k, c) = b.get(pivots[k], c);
+				b.set(pivots[k], c) = tmp;
+			}
+		// L y = P b, unit diagonal
+		for (mdim_t i=1; i<n; i++) {
+			const double* ri = a + (msize_t)i * n;
+			double acc = b.get(i, c);
+			for (mdim_t j=0; j<i; j++)
+				acc -= ri[j] * b.get(j, c);
+			b.set(i, c) = acc;
+		}
+		// U x = y
+		for (mdim_t i=n; i-- > 0; ) {
+			const double* ri = a + (msize_t)i * n;
+			double acc = b.get(i, c);
+			for (mdim_t j=i+1; j<n; j++)
+				acc -= ri[j] * b.get(j, c);
+			b.set(i, c) = acc / ri[i];
+		}
+	}
+	return b;
+}
+
+Matrix LU::solve(const Matrix& b) const {
+	if (singular || b.m != lu.n)
+		return Matrix();
+	Matrix x(b);
+	solveInPlace(x);
+	return x;
+}
+
+double LU::determinant() const {
+	if (singular)
+		return 0.0;
+	double result = sign;
+	for (mdim_t i=0; i<lu.n; i++)
+		result *= lu.data[(msize_t)i * lu.n + i];
+	return result;
+}
+
+Matrix& LU::inverse(Matrix& out) const {
+	mdim_t n = lu.n;
+	if (singular) {
+		out.release();
+		return out;
+	}
+	if (out.m != n || out.n != n || !out.data)
+		out = Matrix(n, n);
+	for (mdim_t i=0; i<n; i++)
+		for (mdim_t j=0; j<n; j++)
+			out.set(i, j) = i == j ? 1.0 : 0.0;
+	return solveInPlace(out);
+}
+
+Matrix LU::inverse() const {
+	Matrix result;
+	inverse(result);
+	return result;
+}
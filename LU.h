@@ -0,0 +1,47 @@
+#ifndef LU_H_
+#define LU_H_
+
+#include "Matrix.h"
+
+// LU decomposition with partial pivoting, P * A = L * U.
+// Factor once, then solve against as many right-hand sides as needed.
+// L (unit diagonal) and U share one n x n row-major buffer.
+//
+//    LU lu(A);
+//    if (!lu.isSingular())
+//        x = lu.solve(b);      // b is n x k, one system per column
+//
+// For allocation-free use hand in the storage: n*n doubles and n pivots.
+class LU {
+public:
+	LU();
+	LU(const Matrix& A);
+	LU(mdim_t n, double* workspace, mdim_t* pivots);
+	~LU();
+
+	// returns false for a singular (or non-square) matrix
+	bool factor(const Matrix& A);
+	bool isSingular() const;
+
+	// solves A * x = b column by column, returns an empty matrix on failure
+	Matrix solve(const Matrix& b) const;
+	// same, overwriting b with x; does not allocate
+	Matrix& solveInPlace(Matrix& b) const;
+
+	double determinant() const;
+	Matrix inverse() const;
+	// writes the inverse into out, allocating only if out is not n x n
+	Matrix& inverse(Matrix& out) const;
+
+	Matrix lu;
+	mdim_t* pivots; // row swapped with row k at step k
+	int sign;       // permutation parity, +1 or -1
+	bool singular;
+	bool ownsPivots;
+
+private:
+	LU(const LU&);
+	LU& operator=(const LU&);
+};
+
+#endif /* LU_H_ */
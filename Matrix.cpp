@@ -1,17 +1,27 @@
 #include "Matrix.h"
+#include "MatrixAllocator.h"
+#include "MatrixStats.h"
+#include "MatrixView.h"
+#include "Transpose.h"
+#include "SparseMatrix.h"
+#include "Gemm.h"
+#include "SmallKernels.h"
+#include "SymmetricEigen.h"
 #include <math.h>
 //#include <iostream>
-Matrix::Matrix(unsigned char m, unsigned char n, double* data, bool transposed) {
+Matrix::Matrix(mdim_t m, mdim_t n, double* data, bool transposed) {
 	this->isTransposed = transposed;
 	this->m = m;
 	this->n = n;
 	this->data = 0;
+	this->allocator = 0;
+	this->capacity = 0;
 	if (data) {
 		this->data = data;
 		isAllocated = false;
 	} else {
 		allocate();
-		for (unsigned char i=0; i<m * n; i++) {
+		for (msize_t i=0; i<(msize_t)m * n; i++) {
 			this->data[i] = 0.0;
 		}
 	}
@@ -21,15 +31,31 @@ Matrix::Matrix(const Matrix &rhs) {
 	m = 0;
 	n = 0;
 	data = 0;
+	isAllocated = false;
+	isTransposed = false;
+	allocator = 0;
+	capacity = 0;
 	copyMatrix(rhs);
 }
 
+Matrix::Matrix(Matrix &&rhs) {
+	m = 0;
+	n = 0;
+	data = 0;
+	isAllocated = false;
+	isTransposed = false;
+	allocator = 0;
+	capacity = 0;
+	*this = static_cast<Matrix&&>(rhs);
+}
+
 Matrix::~Matrix() {
 	release();
 }
 Matrix& Matrix::copyMatrix(const Matrix& another) {
 	if (this != &another) {
-		if (m * n != another.m * another.n) {
+		MATRIX_STATS_OP(MATRIX_OP_COPY, 0.0);
+		if ((msize_t)m * n != (msize_t)another.m * another.n) {
 			m = another.m;
 			n = another.n;
 			allocate();
@@ -37,15 +63,14 @@ Matrix& Matrix::copyMatrix(const Matrix& another) {
 		m = another.m;
 		n = another.n;
 		isTransposed = another.isTransposed;
-		for (unsigned char i = 0; i<m; i++)
-			for (unsigned char j=0; j<n; j++)
-				set(i,j) = another.get(i, j);
+		// same shape and layout, so the raw buffers map one to one
+		copyData(another.data);
 	}
 	return *this;
 }
 
 Matrix& Matrix::copyData(const double* data) {
-	for (unsigned char i=0; i<m*n; i++)
+	for (msize_t i=0; i<(msize_t)m * n; i++)
 		this->data[i] = data[i];
 	return *this;
 }
@@ -54,52 +79,105 @@ Matrix& Matrix::operator=(const Matrix &rhs) {
 	return copyMatrix(rhs);
 }
 
+Matrix& Matrix::operator=(Matrix &&rhs) {
+	if (this != &rhs) {
+		if (!rhs.isAllocated) // aliases keep copy semantics, the buffer is not ours to steal
+			return copyMatrix(rhs);
+		if (!isAllocated && data && (msize_t)m * n == (msize_t)rhs.m * rhs.n)
+			return copyMatrix(rhs); // write through to the caller's storage, as a copy would
+		release();
+		data = rhs.data;
+		m = rhs.m;
+		n = rhs.n;
+		isAllocated = true;
+		isTransposed = rhs.isTransposed;
+		allocator = rhs.allocator;
+		capacity = rhs.capacity;
+		rhs.data = 0;
+		rhs.m = 0;
+		rhs.n = 0;
+		rhs.isAllocated = false;
+		rhs.allocator = 0;
+		rhs.capacity = 0;
+	}
+	return *this;
+}
+
 Matrix& Matrix::operator+=(const Matrix &rhs) {
-	for (unsigned char i=0; i<m; i++)
-		for (unsigned char j=0; j<n; j++)
-			set(i, j) += rhs.get(i, j);
+	apply(rhs, MatrixAddAssign());
 	return *this;
 }
 
 Matrix& Matrix::operator-=(const Matrix &rhs) {
-	for (unsigned char i=0; i<m; i++)
-		for (unsigned char j=0; j<n; j++)
-			set(i, j) -= rhs.get(i, j);
+	apply(rhs, MatrixSubAssign());
 	return *this;
 }
 
 Matrix& Matrix::multiplySelf(const Matrix &rhs) {
 	// element-wise multiplication with self-modification
-	for (unsigned char i=0; i<m; i++)
-		for (unsigned char j=0; j<n; j++)
-			set(i, j) *= rhs.get(i, j);
+	apply(rhs, MatrixMulAssign());
 	return *this;
 }
-Matrix Matrix::multiply(const Matrix &rhs) const{
-	// element-wise multiplication
-	return Matrix(*this).multiplySelf(rhs);
+
+// strides of the logical (i, j) element in data, honouring the lazy transpose
+static inline int rowStride(const Matrix& a) {
+	return a.isTransposed ? 1 : a.n;
+}
+static inline int colStride(const Matrix& a) {
+	return a.isTransposed ? a.m : 1;
+}
+
+static inline bool useGemm(unsigned int m, unsigned int n, unsigned int k) {
+	return (double)m * n * k >= MATRIX_GEMM_THRESHOLD;
+}
+
+// makes C an m x n output: kept as is when it already is m x n, reshaped
+// (row-major) when its buffer holds m * n elements, reallocated otherwise
+static void prepare_into(Matrix& C, mdim_t m, mdim_t n) {
+	if (C.m == m && C.n == n && (C.data || !m || !n))
+		return;
+	if ((msize_t)C.m * C.n != (msize_t)m * n || !C.data) {
+		C.m = m;
+		C.n = n;
+		C.allocate();
+	}
+	C.m = m;
+	C.n = n;
+	C.isTransposed = false;
 }
 
 Matrix& Matrix::dotSelf(const Matrix &b, bool left){
 	Matrix& a = *this;
 
 	if (( left ? a.m : a.n ) == ( left ? b.n : b.m )) {
-		if (( left ? b.m : b.n ) == ( left ? a.m : a.n )) { // very memory-effective. using only n extra floats.
+		const Matrix& x = left ? b : a;
+		const Matrix& y = left ? a : b;
+		if (x.m == a.m && y.n == a.n && small_gemm(x.m, y.n, x.n, 1.0, x.data, rowStride(x), colStride(x),
+				y.data, rowStride(y), colStride(y), 0.0, a.data, rowStride(a), colStride(a))) {
+			MATRIX_STATS_OP(MATRIX_OP_DOT, 2.0 * x.m * x.n * y.n);
+		} else if (useGemm(a.m, a.n, left ? b.m : b.n)) {
+			*this = a.dot(b, left);
+		} else if (( left ? b.m : b.n ) == ( left ? a.m : a.n )) { // very memory-effective. using only n extra floats.
 			if (left) {
 				a.transpose();
 			}
-			double* row = new double[a.n];
-
-			for (unsigned char i=0; i<a.m; i++) {
-				for (unsigned char jj=0; jj<a.n; jj++) {
+			MATRIX_STATS_OP(MATRIX_OP_DOT, 2.0 * a.m * a.n * a.n);
+			// one row of the old values, on the stack unless it is long
+			double small[32];
+			MatrixAllocator* allocator = a.n > 32 ? MatrixAllocator::current() : 0;
+			double* row = allocator ? (double*)allocator->allocate(a.n * sizeof(double)) : small;
+
+			for (mdim_t i=0; i<a.m; i++) {
+				for (mdim_t jj=0; jj<a.n; jj++) {
 					row[jj] = a.get(i, jj);
 					a(i, jj) = 0.0;
 				}
-				for (unsigned char j=0; j<( left ? b.m : b.n ); j++)
-					for (unsigned char k=0; k < a.n; k++)
+				for (mdim_t j=0; j<( left ? b.m : b.n ); j++)
+					for (mdim_t k=0; k < a.n; k++)
 						a(i, j) += row[k] * ( left ? b.get(j, k) : b.get(k, j));
 			}
-			delete[] row;
+			if (allocator)
+				allocator->release(row, a.n * sizeof(double));
 			if (left) {
 				transpose();
 			}
@@ -112,74 +190,74 @@ Matrix& Matrix::dotSelf(const Matrix &b, bool left){
 }
 
 Matrix Matrix::dot(const Matrix &other, bool left) const {
-	if ((left && m != other.n) || (!left && n != other.m)) {
-		return Matrix(0, 0);
-	}
-	Matrix result(left ? n : m, left ? other.m : other.n);
-	for (unsigned char i=0; i < (left ? n : m); i++)
-		for (unsigned char j=0; j < (left ? other.m : other.n); j++)
-			for (unsigned char k=0; k < (left ? m : n); k++)
-				result(i, j) += (left ? get(k, i) : get(i, k)) * (left ? other.get(j, k) : other.get(k, j));
-	if(left) {
-		result.transpose();
-	}
+	// left: other * this, otherwise this * other
+	Matrix result;
+	dot_into(result, left ? other : *this, left ? *this : other);
 	return result;
 }
 
-Matrix& Matrix::operator*=(double scalar){
-	for (unsigned char i=0; i<m * n; i++)
-		data[i] *= scalar;
-	return *this;
+Matrix& Matrix::dot_into(Matrix& C, const Matrix& A, const Matrix& B, double alpha, double beta, bool transA, bool transB) {
+	mdim_t m = transA ? A.n : A.m;
+	mdim_t k = transA ? A.m : A.n;
+	mdim_t n = transB ? B.m : B.n;
+	if (k != (transB ? B.n : B.m) || (beta != 0.0 && (C.m != m || C.n != n))) {
+		C = Matrix();
+		return C;
+	}
+	if (beta == 0.0)
+		prepare_into(C, m, n);
+	MATRIX_STATS_OP(MATRIX_OP_DOT, 2.0 * m * n * k);
+	// op(A)(i, p) = A.data[i * rsa + p * csa], likewise for B and C
+	int rsa = transA ? colStride(A) : rowStride(A);
+	int csa = transA ? rowStride(A) : colStride(A);
+	int rsb = transB ? colStride(B) : rowStride(B);
+	int csb = transB ? rowStride(B) : colStride(B);
+	int rsc = rowStride(C), csc = colStride(C);
+	if (small_gemm(m, n, k, alpha, A.data, rsa, csa, B.data, rsb, csb, beta, C.data, rsc, csc))
+		return C;
+	if (useGemm(m, n, k)) {
+		gemm(m, n, k, alpha, A.data, rsa, csa, B.data, rsb, csb, beta, C.data, rsc, csc);
+		return C;
+	}
+	for (mdim_t i=0; i<m; i++)
+		for (mdim_t j=0; j<n; j++) {
+			const double* a = A.data + (ptrdiff_t)i * rsa;
+			const double* b = B.data + (ptrdiff_t)j * csb;
+			double acc = 0.0;
+			for (mdim_t p=0; p<k; p++)
+				acc += a[(ptrdiff_t)p * csa] * b[(ptrdiff_t)p * rsb];
+			double* c = C.data + (ptrdiff_t)i * rsc + (ptrdiff_t)j * csc;
+			*c = beta == 0.0 ? alpha * acc : alpha * acc + beta * *c;
+		}
+	return C;
 }
 
+Matrix Matrix::dot(const MatrixView &other, bool left) const {
+	return MatrixView(*this).dot(other, left);
+}
 
-
-Matrix Matrix::operator+(const Matrix &rhs) const{
-	return Matrix(*this) += rhs;
-};
-
-Matrix Matrix::operator-(const Matrix &rhs) const{
-	return Matrix(*this) -= rhs;
+Matrix Matrix::dot(const SparseMatrix &other, bool left) const {
+	return other.dot(*this, !left);
 }
-Matrix Matrix::operator-() const{
-	return Matrix(*this) *= -1.0;
+
+Matrix& Matrix::operator*=(double scalar){
+	// reads and writes the same element, so the alias is safe
+	apply(*this * scalar, MatrixAssign());
+	return *this;
 }
+
 Matrix Matrix::operator~() const{
 	Matrix result(*this);
 	result.inverse();
 	return result;
 }
 
-
-Matrix Matrix::operator*(double scalar) const {
-	return Matrix(*this) *= scalar;
-}
-
-double& Matrix::operator()(unsigned char i, unsigned char j){
-	return set(i, j);
-}
-
-const double& Matrix::get(unsigned char i, unsigned char j) const{
-	return data[index(i, j)];
-}
-
-double& Matrix::set(unsigned char i, unsigned char j) {
-	return data[index(i, j)];
-}
-unsigned char Matrix::index(unsigned char i, unsigned char j) const{
-	if (isTransposed)
-		return j * m + i;
-	else
-		return i * n + j;
-}
-
-
 bool  Matrix::operator==(const Matrix &other) const{
 	if (m != other.m || n != other.n)
 		return false;
 
-	for (unsigned char i=0; i<m; i++)
-		for (unsigned char j=0; j<n; j++)
+	for (mdim_t i=0; i<m; i++)
+		for (mdim_t j=0; j<n; j++)
 			if (get(i, j) != other.get(i,j))
 				return false;
 	return true;
@@ -192,25 +270,57 @@ bool  Matrix::operator!=(const Matrix &other) const{
 
 Matrix& Matrix::transpose() {
 	isTransposed = !isTransposed;
-	unsigned char tmp = m; m = n; n=tmp;
+	mdim_t tmp = m; m = n; n=tmp;
 	return *this;
 }
 
+Matrix& Matrix::contiguous() {
+	if (!isTransposed)
+		return *this;
+	if (m == n && isAllocated) {
+		transpose_square(m, data, m);
+		isTransposed = false;
+		return *this;
+	}
+	Matrix result = materialized();
+	release();
+	data = 0; // drop an alias rather than write through it
+	return *this = static_cast<Matrix&&>(result);
+}
+
+Matrix Matrix::materialized() const {
+	Matrix result;
+	result.m = m;
+	result.n = n;
+	result.allocate();
+	if (!isTransposed)
+		result.copyData(data);
+	else // storage is the n x m row-major transpose
+		transpose_copy(n, m, data, m, result.data, n);
+	return result;
+}
+
 Matrix Matrix::transposed() const { // extremely memory-optimal but be aware- data reference is copied! Do not use transposed after parent deletion.
 	return Matrix(n,m,data,!isTransposed);
 }
 
 Matrix& Matrix::inverse() {
-	int pivrow;     // keeps track of current pivot row
-	int k;
+	unsigned int pivrow;     // keeps track of current pivot row
+	unsigned int k;
 	unsigned int i,j;      // k: overall index along diagonal; i: row index; j: col index
-	unsigned int* pivrows = new unsigned int[n]; // keeps track of rows swaps to undo at end
+	MATRIX_STATS_OP(MATRIX_OP_INVERSE, 2.0 * n * n * n);
+	// cofactors when the determinant is usable, pivoting otherwise
+	if (m == n && small_inverse(n, data, data))
+		return *this;
+	MatrixAllocator* allocator = MatrixAllocator::current();
+	unsigned int* pivrows = (unsigned int*)allocator->allocate(n * sizeof(unsigned int)); // keeps track of rows swaps to undo at end
     double tmp;      // used for finding max value and making column swaps
 
     for (k = 0; k < n; k++)
     {
         // find pivot row, the row with biggest entry in current column
         tmp = 0;
+        pivrow = k;
         for (i = k; i < n; i++)
         {
             if (fabs(get(i,k)) >= tmp)   // 'Avoid using other functions inside abs()?'
@@ -223,7 +333,7 @@ Matrix& Matrix::inverse() {
         // check for singular matrix
         if (get(pivrow,k) == 0.0)
         {
-        	delete[] pivrows;
+        	allocator->release(pivrows, n * sizeof(unsigned int));
         	this->release();
             return *this;
         }
@@ -266,7 +376,7 @@ Matrix& Matrix::inverse() {
     }
 
     // Done, now need to undo pivot row swaps by doing column swaps in reverse order
-    for (k = n-1; k >= 0; k--)
+    for (k = n; k-- > 0; )
     {
         if (pivrows[k] != k)
         {
@@ -278,36 +388,61 @@ Matrix& Matrix::inverse() {
             }
         }
     }
-    delete[] pivrows;
+    allocator->release(pivrows, n * sizeof(unsigned int));
     return *this;
 }
 
 double Matrix::trace() const {
+	// (i, i) is i * (n + 1) into the storage, or i * (m + 1) when transposed
+	const ptrdiff_t step = rowStride(*this) + colStride(*this);
+	const mdim_t d = m < n ? m : n;
+	switch (d) {
+	case 2: return data[0] + data[step];
+	case 3: return data[0] + data[step] + data[2 * step];
+	case 4: return data[0] + data[step] + data[2 * step] + data[3 * step];
+	}
 	double result = 0.0;
-	for (unsigned char i=0; i<m && i<n; i++) {
-		result += get(i, i);
+	for (mdim_t i=0; i<d; i++) {
+		result += data[i * step];
 	}
 	return result;
 }
 
 Matrix Matrix::cross(const Matrix& rhs, bool left) const {
-	if (m!=1 || rhs.m!=1 || n!=3 || rhs.n!=3) // for row vectors only
-		return Matrix(); //empty
-	const Matrix& u = left ? rhs : *this;
-	const Matrix& v = left ? *this : rhs;
-
-	Matrix result(1,3);
-	result(0,0) = u.get(0,1) * v.get(0,2) - u.get(0,2) * v.get(0,1);
-	result(0,1) = u.get(0,2) * v.get(0,0) - u.get(0,0) * v.get(0,2);
-	result(0,2) = u.get(0,0) * v.get(0,1) - u.get(0,1) * v.get(0,0);
+	Matrix result;
+	cross_into(result, left ? rhs : *this, left ? *this : rhs);
 	return result;
 }
 
+Matrix& Matrix::cross_into(Matrix& C, const Matrix& u, const Matrix& v) {
+	if (u.m!=1 || v.m!=1 || u.n!=3 || v.n!=3) { // for row vectors only
+		C = Matrix(); //empty
+		return C;
+	}
+	// read everything before writing, C may be u or v
+	double r0 = u.get(0,1) * v.get(0,2) - u.get(0,2) * v.get(0,1);
+	double r1 = u.get(0,2) * v.get(0,0) - u.get(0,0) * v.get(0,2);
+	double r2 = u.get(0,0) * v.get(0,1) - u.get(0,1) * v.get(0,0);
+	prepare_into(C, 1, 3);
+	C(0,0) = r0;
+	C(0,1) = r1;
+	C(0,2) = r2;
+	return C;
+}
+
 Matrix Matrix::quaternion_multiply(const Matrix& rhs, bool left) const {
-	if (m!=1 || rhs.m!=1 || (n!=4 && n!=3) || (rhs.n!=4 && rhs.n!=3)) // for row vectors only
-		return Matrix(); //empty
-	const Matrix& v = left ? rhs : *this;
-	const Matrix& u = left ? *this : rhs;
+	Matrix result;
+	quaternion_multiply_into(result, left ? rhs : *this, left ? *this : rhs);
+	return result;
+}
+
+// v * u; a 1x3 operand is the pure quaternion (0, x, y, z)
+Matrix& Matrix::quaternion_multiply_into(Matrix& C, const Matrix& v, const Matrix& u) {
+	if (v.m!=1 || u.m!=1 || (v.n!=4 && v.n!=3) || (u.n!=4 && u.n!=3)) { // for row vectors only
+		C = Matrix(); //empty
+		return C;
+	}
+	MATRIX_STATS_OP(MATRIX_OP_QUATERNION_MULTIPLY, 28.0);
 
 	double w0,x0,y0,z0;
 	if (u.n==4) {
@@ -341,13 +476,16 @@ Matrix Matrix::quaternion_multiply(const Matrix& rhs, bool left) const {
 		-x1*z0 + y1*w0 + z1*x0 + w1*y0,
 		 x1*y0 - y1*x0 + z1*w0 + w1*z0
 	};
-	Matrix result(1,4,res_);
-	return result;
+	prepare_into(C, 1, 4);
+	for (mdim_t j=0; j<4; j++)
+		C(0,j) = res_[j];
+	return C;
 }
 
 Matrix Matrix::quaternion_inverse() const {
 	if (m!=1 || n!=4) // for row vectors only
 		return Matrix(); //empty
+	MATRIX_STATS_OP(MATRIX_OP_QUATERNION_INVERSE, 11.0);
 
 	double w0 = get(0,0);
 	double x0 = get(0,1);
@@ -362,18 +500,66 @@ Matrix Matrix::quaternion_inverse() const {
 		-y0 * sqr_norm_inv,
 		-z0 * sqr_norm_inv
 	};
-	Matrix result(1,4,res_);
+	Matrix result(1,4);
+	result.copyData(res_);
 	return result;
 }
 
-Matrix Matrix::quaternion_rotate(Matrix& Q) const {
+Matrix Matrix::quaternion_rotate(const Matrix& Q, bool unit) const {
 	if (m!=1 || n!=3|| Q.m!=1 || Q.n!=4) // for row vectors only
 		return Matrix();
-		
-	
-	Matrix tmp = Q.quaternion_multiply(*this).quaternion_multiply(Q.quaternion_inverse());
-	
-	return tmp.submatrix(0,1,0,3);
+	MATRIX_STATS_OP(MATRIX_OP_QUATERNION_ROTATE, unit ? 30.0 : 45.0);
+
+	double w = Q.get(0,0);
+	double x = Q.get(0,1);
+	double y = Q.get(0,2);
+	double z = Q.get(0,3);
+	double vx = get(0,0);
+	double vy = get(0,1);
+	double vz = get(0,2);
+
+	// t = 2 q x v
+	double tx = 2.0 * (y*vz - z*vy);
+	double ty = 2.0 * (z*vx - x*vz);
+	double tz = 2.0 * (x*vy - y*vx);
+
+	Matrix result(1,3);
+	if (unit) {
+		// v + 2w (q x v) + 2 q x (q x v), valid for |Q| = 1 only
+		result(0,0) = vx + w*tx + (y*tz - z*ty);
+		result(0,1) = vy + w*ty + (z*tx - x*tz);
+		result(0,2) = vz + w*tz + (x*ty - y*tx);
+	} else {
+		// Q * v * Q^-1 in closed form: ((w^2 - |q|^2) v + 2 (q.v) q + w t) / |Q|^2
+		double qq = x*x + y*y + z*z;
+		double inv = 1.0 / (w*w + qq);
+		double s = w*w - qq;
+		double d2 = 2.0 * (x*vx + y*vy + z*vz);
+		result(0,0) = (s*vx + d2*x + w*tx) * inv;
+		result(0,1) = (s*vy + d2*y + w*ty) * inv;
+		result(0,2) = (s*vz + d2*z + w*tz) * inv;
+	}
+	return result;
+}
+
+Matrix Matrix::quaternion_to_rotation(const Matrix& Q, bool unit) {
+	if (Q.m!=1 || Q.n!=4)
+		return Matrix();
+
+	double w = Q.get(0,0);
+	double x = Q.get(0,1);
+	double y = Q.get(0,2);
+	double z = Q.get(0,3);
+	double s = unit ? 2.0 : 2.0 / (w*w + x*x + y*y + z*z);
+
+	double R_[] = {
+		1 - s*(y*y + z*z),     s*(x*y - w*z),     s*(x*z + w*y),
+		    s*(x*y + w*z), 1 - s*(x*x + z*z),     s*(y*z - w*x),
+		    s*(x*z - w*y),     s*(y*z + w*x), 1 - s*(x*x + y*y)
+	};
+	Matrix result(3,3);
+	result.copyData(R_);
+	return result;
 }
 
 Matrix& Matrix::normalize() {
@@ -384,10 +570,55 @@ Matrix& Matrix::normalize() {
 	return *this;
 }
 
+#ifdef MATRIX_PARALLEL
+// fixed-size chunks of the raw buffer (element order doesn't matter for
+// either reduction), partials are added up in chunk order afterwards
+struct ReductionTask {
+	const double* data;
+	msize_t size;
+	msize_t grain;
+	bool squares;
+	double* partials;
+	static void run(void* context, msize_t chunk) {
+		ReductionTask& t = *(ReductionTask*)context;
+		msize_t begin = chunk * t.grain;
+		msize_t end = begin + t.grain < t.size ? begin + t.grain : t.size;
+		double acc = 0.0;
+		if (t.squares)
+			for (msize_t k=begin; k<end; k++)
+				acc += t.data[k] * t.data[k];
+		else
+			for (msize_t k=begin; k<end; k++)
+				acc += t.data[k];
+		t.partials[chunk] = acc;
+	}
+};
+
+static bool parallelReduce(const double* data, msize_t size, bool squares, double* result) {
+	if (size < MatrixParallel::reductionThreshold)
+		return false;
+	// the split depends on the size only, so the sum does not change with the thread count
+	ReductionTask task = {data, size, MatrixParallel::reductionGrain, squares, 0};
+	msize_t chunks = (size + task.grain - 1) / task.grain;
+	MatrixAllocator* allocator = MatrixAllocator::current();
+	task.partials = (double*)allocator->allocate(chunks * sizeof(double));
+	MatrixParallel::run(chunks, ReductionTask::run, &task);
+	*result = 0.0;
+	for (msize_t c=0; c<chunks; c++)
+		*result += task.partials[c];
+	allocator->release(task.partials, chunks * sizeof(double));
+	return true;
+}
+#endif
+
 double Matrix::norm() const {
 	double result = 0.0;
-	for (unsigned char i=0; i<m; i++)
-		for (unsigned char j=0; j<n; j++)
+#ifdef MATRIX_PARALLEL
+	if (parallelReduce(data, (msize_t)m * n, true, &result))
+		return sqrt(result);
+#endif
+	for (mdim_t i=0; i<m; i++)
+		for (mdim_t j=0; j<n; j++)
 			result += get(i, j)*get(i, j);
 	result = sqrt(result);
 	return result;
@@ -395,15 +626,19 @@ double Matrix::norm() const {
 
 double Matrix::sum() const {
 	double result = 0.0;
-	for (unsigned char i=0; i<m; i++)
-		for (unsigned char j=0; j<n; j++)
+#ifdef MATRIX_PARALLEL
+	if (parallelReduce(data, (msize_t)m * n, false, &result))
+		return result;
+#endif
+	for (mdim_t i=0; i<m; i++)
+		for (mdim_t j=0; j<n; j++)
 			result += get(i, j);
 	return result;
 }
 
-Matrix Matrix::identity(unsigned char m) {
+Matrix Matrix::identity(mdim_t m) {
 	Matrix result(m,m);
-	for(unsigned char i=0; i<m; i++) {
+	for(mdim_t i=0; i<m; i++) {
 		result(i,i) = 1.0;
 	}
 	return result;
@@ -411,42 +646,93 @@ Matrix Matrix::identity(unsigned char m) {
 
 void Matrix::release() {
 	if (data && isAllocated) {
-//		std::cout << "release: " << m*n << " doubles\n";
-		delete[] data;
+		MATRIX_STATS_RELEASE(capacity * sizeof(double));
+		allocator->release(data, capacity * sizeof(double));
 		data = 0;
 		isAllocated = false;
+		allocator = 0;
+		capacity = 0;
 	}
 }
 void Matrix::allocate() {
 	release();
-	if (m && n)
-		this->data = new double[m * n];
-	else
+	if (m && n) {
+		allocator = MatrixAllocator::current();
+		capacity = (msize_t)m * n;
+		this->data = (double*)allocator->allocate(capacity * sizeof(double));
+		MATRIX_STATS_ALLOCATE(capacity * sizeof(double));
+	} else
 		this->data = 0;
 	isAllocated = true;
-//	std::cout << "allocate: " << m*n << " doubles\n";
 }
 
-Matrix Matrix::submatrix(unsigned char row_top, unsigned char col_left, unsigned char row_bottom, unsigned char col_right) const {
-	unsigned char rows = row_bottom-row_top+1;
-	unsigned char cols = col_right-col_left+1;
-	Matrix result(rows, cols);
-
-	for(unsigned char i=0;i<rows; i++)
-		for(unsigned char j=0; j<cols; j++)
-			result(i,j) = get(row_top+i, col_left+j);
+Matrix Matrix::submatrix(mdim_t row_top, mdim_t col_left, mdim_t row_bottom, mdim_t col_right) const {
+	Matrix result;
+	submatrix_into(result, *this, row_top, col_left, row_bottom, col_right);
 	return result;
 }
 
+Matrix& Matrix::submatrix_into(Matrix& C, const Matrix& A, mdim_t row_top, mdim_t col_left, mdim_t row_bottom, mdim_t col_right) {
+	mdim_t rows = row_bottom-row_top+1;
+	mdim_t cols = col_right-col_left+1;
+	prepare_into(C, rows, cols);
+
+	for(mdim_t i=0;i<rows; i++)
+		for(mdim_t j=0; j<cols; j++)
+			C(i,j) = A.get(row_top+i, col_left+j);
+	return C;
+}
+
+Matrix& Matrix::transposed_into(Matrix& C, const Matrix& A) {
+	prepare_into(C, A.n, A.m);
+	if (C.isTransposed) // C kept a lazily transposed layout, write through it
+		for (mdim_t i=0; i<C.m; i++)
+			for (mdim_t j=0; j<C.n; j++)
+				C(i, j) = A.get(j, i);
+	else if (A.isTransposed) // storage already is the row-major transpose
+		C.copyData(A.data);
+	else
+		transpose_copy(A.m, A.n, A.data, A.n, C.data, C.n);
+	return C;
+}
+
+Matrix& Matrix::add_into(Matrix& C, const Matrix& A, const Matrix& B) {
+	if (A.m != B.m || A.n != B.n) {
+		C = Matrix();
+		return C;
+	}
+	return C = A + B;
+}
+
+Matrix& Matrix::subtract_into(Matrix& C, const Matrix& A, const Matrix& B) {
+	if (A.m != B.m || A.n != B.n) {
+		C = Matrix();
+		return C;
+	}
+	return C = A - B;
+}
+
+Matrix& Matrix::multiply_into(Matrix& C, const Matrix& A, const Matrix& B) {
+	if (A.m != B.m || A.n != B.n) {
+		C = Matrix();
+		return C;
+	}
+	return C = A.multiply(B);
+}
+
+Matrix& Matrix::scale_into(Matrix& C, const Matrix& A, double scalar) {
+	return C = A * scalar;
+}
+
 bool Matrix::closeEnough(const Matrix& another) {
 	if (another.m !=m || another.n != n) {
 		return false;
 	}
 	bool result = true;
 
-	for (unsigned char i=0; result && i<m; i++)
+	for (mdim_t i=0; result && i<m; i++)
 	{
-		for(unsigned char j=0; j<n; j++){
+		for(mdim_t j=0; j<n; j++){
 			if (fabs(get(i,j)-another.get(i,j)) > 1.0e-6) {
 				result = false;
 				break;
@@ -487,3 +773,127 @@ Matrix Matrix::estimate_quaternion(Matrix& A, Matrix& B, Matrix& A2, Matrix& B2)
 
 	return Q;
 }
+
+static inline void cross3(const double* u, const double* v, double* r) {
+	r[0] = u[1] * v[2] - u[2] * v[1];
+	r[1] = u[2] * v[0] - u[0] * v[2];
+	r[2] = u[0] * v[1] - u[1] * v[0];
+}
+
+static inline double dot3(const double* u, const double* v) {
+	return u[0] * v[0] + u[1] * v[1] + u[2] * v[2];
+}
+
+static inline void normalize3(double* v) {
+	double k = sqrt(dot3(v, v));
+	if (k > 0) {
+		k = 1 / k;
+		v[0] *= k;
+		v[1] *= k;
+		v[2] *= k;
+	}
+}
+
+// Same two-step estimate as estimate_quaternion, but on stack arrays:
+// inputs are left untouched and nothing is allocated as long as Q is
+// already 1x4.
+Matrix& Matrix::estimate_quaternion_into(Matrix& Q, const Matrix& A, const Matrix& B, const Matrix& A2, const Matrix& B2) {
+	if (A.m!=1 || A.n!=3 || B.m!=1 || B.n!=3 || A2.m!=1 || A2.n!=3 || B2.m!=1 || B2.n!=3) {
+		Q = Matrix();
+		return Q;
+	}
+	double a[3], b[3], a2[3], b2[3];
+	for (mdim_t j=0; j<3; j++) {
+		a[j] = A.get(0,j);
+		b[j] = B.get(0,j);
+		a2[j] = A2.get(0,j);
+		b2[j] = B2.get(0,j);
+	}
+
+	double n1[3], n2[3], nn[3];
+	cross3(a, b, n1);
+	normalize3(n1);
+	cross3(a2, b2, n2);
+	normalize3(n2);
+
+	double cosa = dot3(n1, n2);
+	double sina = sqrt(0.5 - 0.5*cosa);
+	cosa = sqrt(0.5 + 0.5*cosa);
+	cross3(n1, n2, nn);
+	normalize3(nn);
+	double q1[4] = {cosa, nn[0] * sina, nn[1] * sina, nn[2] * sina};
+
+	// rotate a by q1, Q * v * Q^-1 in closed form
+	double t[3], ar[3];
+	cross3(q1 + 1, a, t);
+	double qq = dot3(q1 + 1, q1 + 1);
+	double inv = 1.0 / (q1[0]*q1[0] + qq);
+	double s = q1[0]*q1[0] - qq;
+	double d2 = 2.0 * dot3(q1 + 1, a);
+	for (int j=0; j<3; j++)
+		ar[j] = (s*a[j] + d2*q1[j+1] + 2.0*q1[0]*t[j]) * inv;
+
+	cosa = dot3(ar, a2);
+	sina = sqrt(0.5 - 0.5*cosa);
+	cosa = sqrt(0.5 + 0.5*cosa);
+	double ax2[3];
+	cross3(ar, a2, ax2);
+	normalize3(ax2);
+	double q2[4] = {cosa, ax2[0] * sina, ax2[1] * sina, ax2[2] * sina};
+
+	if (Q.m != 1 || Q.n != 4 || !Q.data)
+		Q = Matrix(1, 4);
+	// q2 * q1
+	Q(0,0) = q2[0]*q1[0] - q2[1]*q1[1] - q2[2]*q1[2] - q2[3]*q1[3];
+	Q(0,1) = q2[0]*q1[1] + q2[1]*q1[0] + q2[2]*q1[3] - q2[3]*q1[2];
+	Q(0,2) = q2[0]*q1[2] - q2[1]*q1[3] + q2[2]*q1[0] + q2[3]*q1[1];
+	Q(0,3) = q2[0]*q1[3] + q2[1]*q1[2] - q2[2]*q1[1] + q2[3]*q1[0];
+	return Q;
+}
+
+// Davenport q-method: the quaternion Q that best maps every reference
+// vector r onto its observation b in the weighted least-squares (Wahba)
+// sense, so that r.quaternion_rotate(Q) ~ b. Each observation is 7
+// consecutive doubles: weight, bx, by, bz, rx, ry, rz. One O(N) pass builds
+// the 4x4 Davenport matrix K, whose top eigenvector is Q (w >= 0).
+// Returns an empty matrix if there is nothing to fit.
+Matrix Matrix::davenport_quaternion(const double* observations, msize_t count) {
+	if (!count)
+		return Matrix();
+
+	// attitude profile B = sum w b r^T, z = sum w r x b
+	double B[3][3] = {{0, 0, 0}, {0, 0, 0}, {0, 0, 0}};
+	double z[3] = {0, 0, 0};
+	for (msize_t k=0; k<count; k++) {
+		const double* o = observations + 7 * k;
+		double w = o[0];
+		const double* b = o + 1;
+		const double* r = o + 4;
+		for (int i=0; i<3; i++)
+			for (int j=0; j<3; j++)
+				B[i][j] += w * b[i] * r[j];
+		double c[3];
+		cross3(r, b, c);
+		for (int i=0; i<3; i++)
+			z[i] += w * c[i];
+	}
+
+	double sigma = B[0][0] + B[1][1] + B[2][2];
+	Matrix K(4, 4);
+	K(0,0) = sigma;
+	for (int i=0; i<3; i++) {
+		K(0,i+1) = K(i+1,0) = z[i];
+		for (int j=0; j<3; j++)
+			K(i+1,j+1) = B[i][j] + B[j][i] - (i == j ? sigma : 0.0);
+	}
+
+	SymmetricEigen eigen(K);
+	if (!eigen.ok)
+		return Matrix();
+	Matrix Q(1, 4);
+	double sign = eigen.vectors(0, 0) < 0 ? -1.0 : 1.0;
+	for (mdim_t i=0; i<4; i++)
+		Q(0, i) = sign * eigen.vectors(i, 0);
+	Q.normalize();
+	return Q;
+}
@@ -1,18 +1,54 @@
 #ifndef MATRIX_H_
 #define MATRIX_H_
 
-class Matrix {
+#include "MatrixConfig.h"
+#include "MatrixExpr.h"
+#include "Parallel.h"
+
+class MatrixAllocator;
+class MatrixView;
+class SparseMatrix;
+
+class Matrix : public MatrixExpr<Matrix> {
 public:
-	Matrix(unsigned char m=0, unsigned char n=0, double* data=0, bool transposed=false);
+	Matrix(mdim_t m=0, mdim_t n=0, double* data=0, bool transposed=false);
 	Matrix(const Matrix &rhs);
+	Matrix(Matrix &&rhs);
+	template<class E> Matrix(const MatrixExpr<E> &expr);
 	virtual ~Matrix();
-	static Matrix identity(unsigned char m);
+	static Matrix identity(mdim_t m);
 	static Matrix estimate_quaternion(Matrix& A, Matrix& B, Matrix& A2, Matrix& B2);
+	static Matrix davenport_quaternion(const double* observations, msize_t count);
+	static Matrix& estimate_quaternion_into(Matrix& Q, const Matrix& A, const Matrix& B, const Matrix& A2, const Matrix& B2);
+	// Output-parameter forms: the result goes into C, whose buffer is reused
+	// whenever it already holds the right number of elements, so steady-state
+	// code allocates nothing. On a shape error C becomes empty.
+	// C = alpha * op(A) * op(B) + beta * C, op transposing when the flag is
+	// set; with beta != 0 C must already have the result shape. C must not
+	// share storage with A or B.
+	static Matrix& dot_into(Matrix& C, const Matrix& A, const Matrix& B, double alpha=1.0, double beta=0.0,
+			bool transA=false, bool transB=false);
+	// these may alias their inputs
+	static Matrix& cross_into(Matrix& C, const Matrix& A, const Matrix& B);
+	static Matrix& quaternion_multiply_into(Matrix& C, const Matrix& A, const Matrix& B);
+	static Matrix& add_into(Matrix& C, const Matrix& A, const Matrix& B);
+	static Matrix& subtract_into(Matrix& C, const Matrix& A, const Matrix& B);
+	static Matrix& multiply_into(Matrix& C, const Matrix& A, const Matrix& B); // element-wise
+	static Matrix& scale_into(Matrix& C, const Matrix& A, double scalar);
+	// physical copies; C must not share storage with A
+	static Matrix& transposed_into(Matrix& C, const Matrix& A);
+	static Matrix& submatrix_into(Matrix& C, const Matrix& A, mdim_t row_top, mdim_t col_left, mdim_t row_bottom, mdim_t col_right);
 	Matrix& copyData(const double * data);
 	Matrix& copyMatrix(const Matrix& m);
 	Matrix& operator=(const Matrix &rhs);
+	Matrix& operator=(Matrix &&rhs);
+	template<class E> Matrix& operator=(const MatrixExpr<E> &expr);
 	Matrix& operator+=(const Matrix &rhs);
 	Matrix& operator-=(const Matrix &rhs);
+	template<class E> Matrix& operator+=(const MatrixExpr<E> &expr);
+	template<class E> Matrix& operator-=(const MatrixExpr<E> &expr);
+	template<class E, class Op> void apply(const E& e, Op op);
+	template<class E, class Op> void applyRows(const E& e, Op op, msize_t begin, msize_t end);
 	Matrix& operator*=(double scalar);
 	Matrix& multiplySelf(const Matrix &rhs);
 	Matrix& dotSelf(const Matrix &rhs, bool left=false);
@@ -21,22 +57,27 @@ public:
 	double sum() const;
 
 	Matrix  dot(const Matrix &rhs, bool left=false) const;
+	Matrix  dot(const MatrixView &rhs, bool left=false) const;
+	Matrix  dot(const SparseMatrix &rhs, bool left=false) const;
 	Matrix  cross(const Matrix &rhs, bool left=false) const;
 	Matrix  quaternion_multiply(const Matrix &rhs, bool left=false) const;
 	Matrix quaternion_inverse() const;
-	Matrix quaternion_rotate(Matrix& Q) const;
-	Matrix multiply(const Matrix &rhs) const;
-	Matrix operator+(const Matrix &rhs) const;
-	Matrix operator-(const Matrix &rhs) const;
-	Matrix operator-() const;
+	Matrix quaternion_rotate(const Matrix& Q, bool unit=false) const;
+	static Matrix quaternion_to_rotation(const Matrix& Q, bool unit=false);
+	template<class E> MatrixProduct<Matrix, E> multiply(const MatrixExpr<E> &rhs) const;
 	Matrix operator~() const; // inverse
-	Matrix operator*(double scalar) const;
-	Matrix submatrix(unsigned char row_top, unsigned char col_left, unsigned char row_bottom, unsigned char col_right) const;
-	double& operator()(unsigned char i, unsigned char j=0);
+	Matrix submatrix(mdim_t row_top, mdim_t col_left, mdim_t row_bottom, mdim_t col_right) const;
+	double& operator()(mdim_t i, mdim_t j=0);
 
-	const double& get(unsigned char i, unsigned char j) const;
-	double& set(unsigned char i, unsigned char j);
-	unsigned char index(unsigned char i, unsigned char j) const;
+	const double& get(mdim_t i, mdim_t j) const;
+	double& set(mdim_t i, mdim_t j);
+	msize_t index(mdim_t i, mdim_t j) const;
+	// expression interface: linear access, valid when rowMajor()
+	double at(msize_t k) const { return data[k]; }
+	bool rowMajor() const { return !isTransposed; }
+	bool aliases(const double* p, int rs, int cs) const {
+		return data == p && (rs != (isTransposed ? 1 : (int)n) || cs != (isTransposed ? (int)m : 1));
+	}
 
 	bool  operator==(const Matrix &other) const;
 	bool  operator!=(const Matrix &other) const;
@@ -46,17 +87,145 @@ public:
 
 	Matrix& transpose();
 	Matrix transposed() const;
+	// physically reorders a lazily transposed matrix into row-major
+	// storage (in place when square and owned); an alias becomes an owning copy
+	Matrix& contiguous();
+	// row-major owning copy
+	Matrix materialized() const;
 	void release();
 	void allocate();
 	bool closeEnough(const Matrix& another);
 
 	double* data;
-	unsigned char m;
-	unsigned char n;
+	mdim_t m;
+	mdim_t n;
 	bool isAllocated;
 	bool isTransposed;
+	// where an owned buffer came from and how many doubles it holds
+	MatrixAllocator* allocator;
+	msize_t capacity;
 };
 
+inline double& Matrix::operator()(mdim_t i, mdim_t j){
+	return set(i, j);
+}
+
+inline const double& Matrix::get(mdim_t i, mdim_t j) const{
+	return data[index(i, j)];
+}
+
+inline double& Matrix::set(mdim_t i, mdim_t j) {
+	return data[index(i, j)];
+}
+
+inline msize_t Matrix::index(mdim_t i, mdim_t j) const{
+	if (isTransposed)
+		return (msize_t)j * m + i;
+	else
+		return (msize_t)i * n + j;
+}
+
+template<class E>
+Matrix::Matrix(const MatrixExpr<E> &expr) {
+	m = 0;
+	n = 0;
+	data = 0;
+	isAllocated = false;
+	isTransposed = false;
+	allocator = 0;
+	capacity = 0;
+	*this = expr;
+}
+
+template<class E>
+Matrix& Matrix::operator=(const MatrixExpr<E> &expr) {
+	const E& e = expr.self();
+	if ((msize_t)m * n != (msize_t)e.m * e.n || !data) {
+		m = e.m;
+		n = e.n;
+		allocate();
+	}
+	m = e.m;
+	n = e.n;
+	apply(e, MatrixAssign());
+	return *this;
+}
+
+template<class E>
+Matrix& Matrix::operator+=(const MatrixExpr<E> &expr) {
+	apply(expr.self(), MatrixAddAssign());
+	return *this;
+}
+
+template<class E>
+Matrix& Matrix::operator-=(const MatrixExpr<E> &expr) {
+	apply(expr.self(), MatrixSubAssign());
+	return *this;
+}
+
+#ifdef MATRIX_PARALLEL
+// one band of rows per chunk
+template<class E, class Op>
+struct MatrixApplyTask {
+	Matrix* target;
+	const E* e;
+	Op op;
+	msize_t rows;
+	static void run(void* context, msize_t chunk) {
+		MatrixApplyTask& t = *(MatrixApplyTask*)context;
+		msize_t begin = chunk * t.rows;
+		msize_t end = begin + t.rows < t.target->m ? begin + t.rows : t.target->m;
+		t.target->applyRows(*t.e, t.op, begin, end);
+	}
+};
+#endif
+
+// element-wise kernel behind =, +=, -=, multiplySelf and *=
+template<class E, class Op>
+void Matrix::apply(const E& e, Op op) {
+	if (e.aliases(data, isTransposed ? 1 : (int)n, isTransposed ? (int)m : 1)) {
+		// this is also an operand, read in another layout: evaluate it first
+		Matrix value(e.m, e.n);
+		value.applyRows(e, MatrixAssign(), 0, e.m);
+		apply(value, op);
+		return;
+	}
+#ifdef MATRIX_PARALLEL
+	unsigned int threads = MatrixParallel::threads();
+	if (threads > 1 && m > 1 && (msize_t)m * n >= MatrixParallel::elementwiseThreshold) {
+		// bands of whole tiles, a few per thread for balance
+		msize_t rows = (m + 4 * threads - 1) / (4 * threads);
+		rows = (rows + MATRIX_TILE - 1) / MATRIX_TILE * MATRIX_TILE;
+		MatrixApplyTask<E, Op> task = {this, &e, op, rows};
+		MatrixParallel::run((m + rows - 1) / rows, MatrixApplyTask<E, Op>::run, &task);
+		return;
+	}
+#endif
+	applyRows(e, op, 0, m);
+}
+
+// linear when both sides are row-major, otherwise tile by tile
+template<class E, class Op>
+void Matrix::applyRows(const E& e, Op op, msize_t begin, msize_t end) {
+	if (!isTransposed && e.rowMajor()) {
+		for (msize_t k=begin * n; k<end * n; k++)
+			op(data[k], e.at(k));
+		return;
+	}
+	for (msize_t i0=begin; i0<end; i0+=MATRIX_TILE)
+		for (msize_t j0=0; j0<n; j0+=MATRIX_TILE) {
+			msize_t iend = i0 + MATRIX_TILE < end ? i0 + MATRIX_TILE : end;
+			msize_t jend = j0 + MATRIX_TILE < n ? j0 + MATRIX_TILE : n;
+			for (msize_t i=i0; i<iend; i++)
+				for (msize_t j=j0; j<jend; j++)
+					op(set(i, j), e.get(i, j));
+		}
+}
 
+template<class E>
+MatrixProduct<Matrix, E> Matrix::multiply(const MatrixExpr<E> &rhs) const {
+	// element-wise multiplication, evaluated lazily
+	return MatrixProduct<Matrix, E>(*this, rhs.self());
+}
 
 #endif /* MATRIX_H_ */
@@ -0,0 +1,208 @@
+#include "MatrixAllocator.h"
+
+// blocks handed out are aligned to this many bytes
+#define ALLOC_ALIGN 16
+
+static size_t alignUp(size_t bytes) {
+	return (bytes + ALLOC_ALIGN - 1) & ~(size_t)(ALLOC_ALIGN - 1);
+}
+
+static MatrixAllocator* currentAllocator = 0;
+
+MatrixAllocator::MatrixAllocator() {
+	resetStats();
+}
+
+MatrixAllocator::~MatrixAllocator() {
+}
+
+const MatrixAllocStats& MatrixAllocator::stats() const {
+	return counters;
+}
+
+void MatrixAllocator::resetStats() {
+	counters.allocations = 0;
+	counters.releases = 0;
+	counters.systemAllocations = 0;
+	counters.systemReleases = 0;
+	counters.bytesInUse = 0;
+	counters.peakBytes = 0;
+}
+
+MatrixAllocator* MatrixAllocator::current() {
+	// created on first use so matrices at namespace scope in other files can
+	// allocate during static initialization, and never destroyed so they can
+	// still release during static destruction
+	static HeapAllocator* heap = new HeapAllocator();
+	return currentAllocator ? currentAllocator : heap;
+}
+
+void MatrixAllocator::setCurrent(MatrixAllocator* allocator) {
+	currentAllocator = allocator;
+}
+
+void* MatrixAllocator::systemAllocate(size_t bytes) {
+	counters.systemAllocations++;
+	// new[] of double keeps the 16 byte alignment on common targets
+	return new double[(bytes + sizeof(double) - 1) / sizeof(double)];
+}
+
+void MatrixAllocator::systemRelease(void* p) {
+	counters.systemReleases++;
+	delete[] (double*)p;
+}
+
+void MatrixAllocator::served(size_t bytes) {
+	counters.allocations++;
+	counters.bytesInUse += bytes;
+	if (counters.bytesInUse > counters.peakBytes)
+		counters.peakBytes = counters.bytesInUse;
+}
+
+void MatrixAllocator::returned(size_t bytes) {
+	counters.releases++;
+	counters.bytesInUse -= bytes;
+}
+
+void* HeapAllocator::allocate(size_t bytes) {
+	served(bytes);
+	return systemAllocate(bytes);
+}
+
+void HeapAllocator::release(void* p, size_t bytes) {
+	returned(bytes);
+	systemRelease(p);
+}
+
+ArenaAllocator::ArenaAllocator(size_t capacity) {
+	size = capacity;
+	top = 0;
+	arenaBytes = 0;
+	ownsBuffer = true;
+	buffer = (char*)systemAllocate(capacity);
+	resetStats();
+}
+
+ArenaAllocator::ArenaAllocator(void* buffer, size_t capacity) {
+	this->buffer = (char*)buffer;
+	size = capacity;
+	top = 0;
+	arenaBytes = 0;
+	ownsBuffer = false;
+}
+
+ArenaAllocator::~ArenaAllocator() {
+	if (ownsBuffer)
+		delete[] (double*)buffer;
+}
+
+void* ArenaAllocator::allocate(size_t bytes) {
+	size_t need = alignUp(bytes);
+	served(bytes);
+	if (need > size - top)
+		return systemAllocate(bytes);
+	arenaBytes += bytes;
+	void* p = buffer + top;
+	top += need;
+	return p;
+}
+
+void ArenaAllocator::release(void* p, size_t bytes) {
+	char* c = (char*)p;
+	if (c < buffer || c >= buffer + size) {
+		returned(bytes);
+		systemRelease(p);
+		return;
+	}
+	// a block served before the last reset was already dropped from the count
+	size_t counted = bytes < arenaBytes ? bytes : arenaBytes;
+	arenaBytes -= counted;
+	returned(counted);
+	// only the most recent block can be popped
+	if (c + alignUp(bytes) == buffer + top)
+		top = c - buffer;
+}
+
+void ArenaAllocator::reset() {
+	top = 0;
+	counters.bytesInUse -= arenaBytes;
+	arenaBytes = 0;
+}
+
+size_t ArenaAllocator::used() const {
+	return top;
+}
+
+size_t ArenaAllocator::capacity() const {
+	return size;
+}
+
+PoolAllocator::PoolAllocator(size_t chunkBytes, size_t maxBlock) {
+	this->chunkBytes = chunkBytes;
+	chunks = 0;
+	classes = 0;
+	while (classes < MAX_CLASSES && ((size_t)1 << (classes + MIN_SHIFT)) <= maxBlock)
+		classes++;
+	for (int i=0; i<MAX_CLASSES; i++)
+		freeLists[i] = 0;
+}
+
+PoolAllocator::~PoolAllocator() {
+	while (chunks) {
+		void* next = *(void**)chunks;
+		delete[] (double*)chunks;
+		chunks = next;
+	}
+}
+
+int PoolAllocator::sizeClass(size_t bytes) const {
+	int c = 0;
+	while (c < classes && ((size_t)1 << (c + MIN_SHIFT)) < bytes)
+		c++;
+	return c < classes ? c : -1;
+}
+
+void* PoolAllocator::allocate(size_t bytes) {
+	served(bytes);
+	int c = sizeClass(bytes);
+	if (c < 0)
+		return systemAllocate(bytes);
+
+	if (!freeLists[c]) {
+		// carve a new chunk into blocks of this class; the first
+		// ALLOC_ALIGN bytes link the chunk list
+		size_t block = (size_t)1 << (c + MIN_SHIFT);
+		size_t payload = chunkBytes > block ? chunkBytes : block;
+		char* chunk = (char*)systemAllocate(payload + ALLOC_ALIGN);
+		*(void**)chunk = chunks;
+		chunks = chunk;
+		for (size_t off=ALLOC_ALIGN; off + block <= payload + ALLOC_ALIGN; off += block) {
+			void* p = chunk + off;
+			*(void**)p = freeLists[c];
+			freeLists[c] = p;
+		}
+	}
+	void* p = freeLists[c];
+	freeLists[c] = *(void**)p;
+	return p;
+}
+
+void PoolAllocator::release(void* p, size_t bytes) {
+	returned(bytes);
+	int c = sizeClass(bytes);
+	if (c < 0) {
+		systemRelease(p);
+		return;
+	}
+	*(void**)p = freeLists[c];
+	freeLists[c] = p;
+}
+
+MatrixAllocatorScope::MatrixAllocatorScope(MatrixAllocator& allocator) {
+	previous = MatrixAllocator::current();
+	MatrixAllocator::setCurrent(&allocator);
+}
+
+MatrixAllocatorScope::~MatrixAllocatorScope() {
+	MatrixAllocator::setCurrent(previous);
+}
@@ -0,0 +1,114 @@
+#ifndef MATRIXALLOCATOR_H_
+#define MATRIXALLOCATOR_H_
+
+#include <stddef.h>
+
+struct MatrixAllocStats {
+	unsigned long allocations;       // requests served
+	unsigned long releases;
+	unsigned long systemAllocations; // requests that had to go to new[]
+	unsigned long systemReleases;
+	size_t bytesInUse;
+	size_t peakBytes;
+};
+
+// Storage provider for Matrix data (and gemm scratch). Matrix::allocate
+// asks MatrixAllocator::current(); each Matrix remembers the allocator
+// its buffer came from and hands it back there on release. The current
+// allocator is a process-wide setting and not thread-safe.
+class MatrixAllocator {
+public:
+	MatrixAllocator();
+	virtual ~MatrixAllocator();
+
+	virtual void* allocate(size_t bytes) = 0;
+	virtual void release(void* p, size_t bytes) = 0;
+
+	const MatrixAllocStats& stats() const;
+	void resetStats();
+
+	// the heap allocator unless one was installed
+	static MatrixAllocator* current();
+	// 0 restores the heap allocator
+	static void setCurrent(MatrixAllocator* allocator);
+
+protected:
+	void* systemAllocate(size_t bytes);
+	void systemRelease(void* p);
+	void served(size_t bytes);
+	void returned(size_t bytes);
+	MatrixAllocStats counters;
+};
+
+// plain new[] / delete[]
+class HeapAllocator : public MatrixAllocator {
+public:
+	virtual void* allocate(size_t bytes);
+	virtual void release(void* p, size_t bytes);
+};
+
+// Bump allocator over one block, meant to be reset once per frame.
+// release() only reclaims the most recent allocation; everything else is
+// reclaimed by reset(). Requests that do not fit fall back to the heap
+// (and show up in systemAllocations). Matrices allocated from the arena
+// must not be used after reset(). reset() drops only the arena's own bytes
+// from bytesInUse: heap fallbacks stay counted until they are released,
+// and arena blocks released after the reset that dropped them are not
+// subtracted twice.
+class ArenaAllocator : public MatrixAllocator {
+public:
+	ArenaAllocator(size_t capacity);
+	// uses caller storage, e.g. a static buffer on embedded targets
+	ArenaAllocator(void* buffer, size_t capacity);
+	virtual ~ArenaAllocator();
+
+	virtual void* allocate(size_t bytes);
+	virtual void release(void* p, size_t bytes);
+	void reset();
+	size_t used() const;
+	size_t capacity() const;
+
+private:
+	ArenaAllocator(const ArenaAllocator&);
+	ArenaAllocator& operator=(const ArenaAllocator&);
+	char* buffer;
+	size_t size;
+	size_t top;
+	size_t arenaBytes; // part of bytesInUse served from buffer
+	bool ownsBuffer;
+};
+
+// Power-of-two size classes from 16 bytes to maxBlock, each with its own
+// free list. Blocks are carved out of chunks taken from the heap and are
+// recycled on release, so a steady workload stops touching the heap once
+// warmed up. Larger requests go straight to the heap. Chunks are returned
+// when the pool is destroyed.
+class PoolAllocator : public MatrixAllocator {
+public:
+	PoolAllocator(size_t chunkBytes=4096, size_t maxBlock=16384);
+	virtual ~PoolAllocator();
+
+	virtual void* allocate(size_t bytes);
+	virtual void release(void* p, size_t bytes);
+
+private:
+	PoolAllocator(const PoolAllocator&);
+	PoolAllocator& operator=(const PoolAllocator&);
+	enum { MIN_SHIFT = 4, MAX_CLASSES = 24 };
+	int sizeClass(size_t bytes) const;
+	void* freeLists[MAX_CLASSES];
+	void* chunks;
+	size_t chunkBytes;
+	int classes;
+};
+
+// installs an allocator for the lifetime of the scope
+class MatrixAllocatorScope {
+public:
+	MatrixAllocatorScope(MatrixAllocator& allocator);
+	~MatrixAllocatorScope();
+private:
+	MatrixAllocator* previous;
+};
+
+#endif /* MATRIXALLOCATOR_H_ */
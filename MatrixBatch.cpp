@@ -0,0 +1,237 @@
+#include "MatrixBatch.h"
+#include "MatrixSimd.h"
+#include "SmallKernels.h"
+#include <math.h>
+#include <stdint.h>
+
+// lanes are padded to this many elements and aligned to 32 bytes
+#define BATCH_PAD 4
+
+static msize_t padded(msize_t count) {
+	return (count + BATCH_PAD - 1) / BATCH_PAD * BATCH_PAD;
+}
+
+// lane stride for count matrices: one extra block keeps a power-of-two
+// count from putting every lane of a matrix in the same cache set
+static msize_t stride(msize_t count) {
+	return padded(count) + BATCH_PAD;
+}
+
+MatrixBatch::MatrixBatch(mdim_t m, mdim_t n, msize_t count) {
+	storage = 0;
+	data = 0;
+	capacity = 0;
+	lanes = 0;
+	this->m = 0;
+	this->n = 0;
+	this->count = 0;
+	resize(m, n, count);
+}
+
+MatrixBatch::~MatrixBatch() {
+	delete[] storage;
+}
+
+void MatrixBatch::resize(mdim_t m, mdim_t n, msize_t count) {
+	msize_t needed = (msize_t)m * n;
+	if (padded(count) > capacity || needed > lanes) {
+		delete[] storage;
+		capacity = stride(count) > capacity ? stride(count) : capacity;
+		lanes = needed > lanes ? needed : lanes;
+		storage = new double[lanes * capacity + BATCH_PAD];
+		data = (double*)(((uintptr_t)storage + 31) & ~(uintptr_t)31);
+		for (msize_t i=0; i<lanes * capacity; i++)
+			data[i] = 0.0;
+	}
+	this->m = m;
+	this->n = n;
+	this->count = count;
+}
+
+template<typename T>
+static inline void swapValues(T& a, T& b) {
+	T tmp = a;
+	a = b;
+	b = tmp;
+}
+
+void MatrixBatch::swap(MatrixBatch& other) {
+	swapValues(m, other.m);
+	swapValues(n, other.n);
+	swapValues(count, other.count);
+	swapValues(data, other.data);
+	swapValues(storage, other.storage);
+	swapValues(capacity, other.capacity);
+	swapValues(lanes, other.lanes);
+}
+
+void MatrixBatch::set(msize_t k, const Matrix& A) {
+	for (mdim_t i=0; i<m; i++)
+		for (mdim_t j=0; j<n; j++)
+			lane(i, j)[k] = A.get(i, j);
+}
+
+Matrix MatrixBatch::get(msize_t k) const {
+	Matrix result(m, n);
+	get(k, result);
+	return result;
+}
+
+Matrix& MatrixBatch::get(msize_t k, Matrix& out) const {
+	if (out.m != m || out.n != n || !out.data)
+		out = Matrix(m, n);
+	for (mdim_t i=0; i<m; i++)
+		for (mdim_t j=0; j<n; j++)
+			out(i, j) = lane(i, j)[k];
+	return out;
+}
+
+// Kernels run over whole SIMD blocks; the padding lanes are computed too
+// and simply never read back.
+
+bool MatrixBatch::dot(const MatrixBatch& rhs, MatrixBatch& out) const {
+	if (n != rhs.m || count != rhs.count)
+		return false;
+	if (&out == this || &out == &rhs) {
+		MatrixBatch result;
+		dot(rhs, result);
+		out.swap(result);
+		return true;
+	}
+	mdim_t inner = n;
+	out.resize(m, rhs.n, count);
+	msize_t end = padded(out.count);
+	for (msize_t b=0; b<end; b+=SIMD_WIDTH)
+		for (mdim_t i=0; i<out.m; i++)
+			for (mdim_t j=0; j<out.n; j++) {
+				simd_d acc = simd_set1(0.0);
+				for (mdim_t p=0; p<inner; p++)
+					acc = simd_add(acc, simd_mul(simd_load(lane(i, p) + b), simd_load(rhs.lane(p, j) + b)));
+				simd_store(out.lane(i, j) + b, acc);
+			}
+	return true;
+}
+
+bool MatrixBatch::inverse(MatrixBatch& out) const {
+	if (m != n)
+		return false;
+	out.resize(m, n, count);
+	bool ok = true;
+	if (n > 4 || n < 2) {
+		// no closed form: one Gauss-Jordan per matrix, through a scratch Matrix
+		Matrix work(n, n);
+		for (msize_t k=0; k<count; k++) {
+			get(k, work);
+			work.inverse();
+			if (!work.data) { // singular, inverse() released it
+				ok = false;
+				work = Matrix(n, n);
+				continue;
+			}
+			out.set(k, work);
+		}
+		return ok;
+	}
+	msize_t size = (msize_t)n * n;
+	msize_t end = padded(count);
+	simd_d one = simd_set1(1.0);
+	for (msize_t b=0; b<end; b+=SIMD_WIDTH) {
+		simd_d a[16], inv[16], det;
+		for (msize_t e=0; e<size; e++)
+			a[e] = simd_load(data + e * capacity + b);
+		if (n == 2) {
+			Cofactors2<simd_d> f(a);
+			det = f.det;
+			f.write(simd_div(one, det), inv);
+		} else if (n == 3) {
+			Cofactors3<simd_d> f(a);
+			det = f.det;
+			f.write(simd_div(one, det), inv);
+		} else {
+			Cofactors4<simd_d> f(a);
+			det = f.det;
+			f.write(simd_div(one, det), inv);
+		}
+		for (msize_t e=0; e<size; e++)
+			simd_store(out.data + e * out.capacity + b, inv[e]);
+
+		// as in Matrix::inverse, a determinant the closed form cannot use
+		// sends that matrix through Gauss-Jordan, rebuilt from the loaded
+		// lanes since out may be this
+		double d[SIMD_WIDTH];
+		simd_store(d, det);
+		for (int t=0; t<SIMD_WIDTH && b + t < count; t++) {
+			double r = 1.0 / d[t];
+			if (d[t] != 0.0 && isfinite(d[t]) && isfinite(r))
+				continue;
+			Matrix work(n, n);
+			for (msize_t e=0; e<size; e++) {
+				double vals[SIMD_WIDTH];
+				simd_store(vals, a[e]);
+				work.data[e] = vals[t];
+			}
+			work.inverse();
+			if (!work.data) // singular, inverse() released it
+				ok = false;
+			else
+				out.set(b + t, work);
+		}
+	}
+	return ok;
+}
+
+void MatrixBatch::transpose(MatrixBatch& out) const {
+	if (&out == this) {
+		MatrixBatch result;
+		transpose(result);
+		out.swap(result);
+		return;
+	}
+	out.resize(n, m, count);
+	msize_t end = padded(count);
+	for (mdim_t i=0; i<m; i++)
+		for (mdim_t j=0; j<n; j++) {
+			const double* src = lane(i, j);
+			double* dst = out.lane(j, i);
+			for (msize_t b=0; b<end; b+=SIMD_WIDTH)
+				simd_store(dst + b, simd_load(src + b));
+		}
+}
+
+MatrixBatch& MatrixBatch::normalize() {
+	msize_t size = (msize_t)m * n;
+	msize_t end = padded(count);
+	simd_d one = simd_set1(1.0);
+	for (msize_t b=0; b<end; b+=SIMD_WIDTH) {
+		simd_d sqr = simd_set1(0.0);
+		for (msize_t e=0; e<size; e++) {
+			simd_d v = simd_load(data + e * capacity + b);
+			sqr = simd_add(sqr, simd_mul(v, v));
+		}
+		// 1 / norm, or 0 where the norm is 0: zero matrices stay zero, like
+		// Matrix::normalize (the 1 / 0 in those lanes is masked away)
+		simd_d inv = simd_where_positive(sqr, simd_div(one, simd_sqrt(sqr)));
+		for (msize_t e=0; e<size; e++) {
+			double* p = data + e * capacity + b;
+			simd_store(p, simd_mul(simd_load(p), inv));
+		}
+	}
+	return *this;
+}
+
+void MatrixBatch::norm(double* out) const {
+	msize_t size = (msize_t)m * n;
+	msize_t end = padded(count);
+	for (msize_t b=0; b<end; b+=SIMD_WIDTH) {
+		simd_d sqr = simd_set1(0.0);
+		for (msize_t e=0; e<size; e++) {
+			simd_d v = simd_load(data + e * capacity + b);
+			sqr = simd_add(sqr, simd_mul(v, v));
+		}
+		double r[SIMD_WIDTH];
+		simd_store(r, simd_sqrt(sqr));
+		// out holds exactly count values
+		for (int t=0; t<SIMD_WIDTH && b + t < count; t++)
+			out[b + t] = r[t];
+	}
+}
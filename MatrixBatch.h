@@ -0,0 +1,66 @@
+#ifndef MATRIXBATCH_H_
+#define MATRIXBATCH_H_
+
+#include "Matrix.h"
+
+// count matrices of one m x n shape in structure-of-arrays form: element
+// (i, j) of every matrix lives in its own 32-byte aligned lane, padded to a
+// multiple of 4, so the kernels work on SIMD_WIDTH matrices per step with
+// the same instruction sequence a single matrix would get. Meant for
+// thousands of small transforms per tick, where a Matrix each costs a heap
+// block and per-element index() calls.
+//
+//    MatrixBatch R(3, 3, count), v(3, 1, count), Rv;
+//    for (msize_t k=0; k<count; k++)
+//        R.set(k, rotation[k]);
+//    R.dot(v, Rv);                 // Rv[k] = R[k] * v[k]
+//
+// Products and norms add up in the same order as Matrix::dot and
+// Matrix::norm. Outputs may alias inputs. Growing a batch past its
+// capacity discards its contents.
+class MatrixBatch {
+public:
+	MatrixBatch(mdim_t m=0, mdim_t n=0, msize_t count=0);
+	~MatrixBatch();
+	void resize(mdim_t m, mdim_t n, msize_t count);
+
+	// gather/scatter one m x n matrix; get(k, out) reuses out's buffer
+	// when it is already m x n
+	void set(msize_t k, const Matrix& A);
+	Matrix get(msize_t k) const;
+	Matrix& get(msize_t k, Matrix& out) const;
+
+	// the count values of element (i, j)
+	double* lane(mdim_t i, mdim_t j) { return data + ((msize_t)i * n + j) * capacity; }
+	const double* lane(mdim_t i, mdim_t j) const { return data + ((msize_t)i * n + j) * capacity; }
+
+	// out[k] = this[k] * rhs[k]; false if the inner dimensions or the
+	// counts differ
+	bool dot(const MatrixBatch& rhs, MatrixBatch& out) const;
+	// out[k] = this[k]^-1, by cofactors up to 4x4 and per matrix above or
+	// when a determinant over- or underflows. False if the matrices are not
+	// square or any of them is singular; those come out as inf/NaN (or
+	// unchanged above 4x4).
+	bool inverse(MatrixBatch& out) const;
+	// out[k] = this[k]^T
+	void transpose(MatrixBatch& out) const;
+	// each matrix divided by its Frobenius norm; zero matrices stay zero
+	MatrixBatch& normalize();
+	// out[k] = Frobenius norm of this[k], count values
+	void norm(double* out) const;
+
+	mdim_t m;
+	mdim_t n;
+	msize_t count;
+	double* data;
+
+private:
+	MatrixBatch(const MatrixBatch&);
+	MatrixBatch& operator=(const MatrixBatch&);
+	void swap(MatrixBatch& other);
+	double* storage;
+	msize_t capacity;
+	msize_t lanes;
+};
+
+#endif /* MATRIXBATCH_H_ */
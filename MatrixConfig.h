@@ -0,0 +1,26 @@
+#ifndef MATRIXCONFIG_H_
+#define MATRIXCONFIG_H_
+
+#include <stddef.h>
+
+// Dimension (mdim_t) and element-index (msize_t) types.
+// AVR builds keep the compact 8-bit dimensions, everything else gets
+// full-size ones so a matrix can hold thousands of rows. Define
+// MATRIX_COMPACT to force the 8-bit layout, or MATRIX_LARGE to lift it
+// on AVR. The whole program must be built with the same choice.
+#if defined(MATRIX_COMPACT) || (defined(__AVR__) && !defined(MATRIX_LARGE))
+typedef unsigned char mdim_t;
+typedef unsigned int msize_t;
+#else
+typedef unsigned int mdim_t;
+typedef size_t msize_t;
+#endif
+
+// Element-wise kernels visit a matrix in MATRIX_TILE x MATRIX_TILE tiles
+// whenever an operand is not plain row-major (e.g. lazily transposed), so
+// the strided side stays in cache.
+#ifndef MATRIX_TILE
+#define MATRIX_TILE 32
+#endif
+
+#endif /* MATRIXCONFIG_H_ */
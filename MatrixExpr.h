@@ -0,0 +1,137 @@
+#ifndef MATRIXEXPR_H_
+#define MATRIXEXPR_H_
+
+// Lazy elementwise expressions over Matrix.
+// a + b - c * 1.5 builds a tree of lightweight nodes; nothing is computed
+// until the tree is assigned to (or added into) a Matrix, which then
+// evaluates every element in a single pass.
+//
+// Every expression provides m, n, get(i, j) and, for the linear fast path,
+// rowMajor() and at(k). aliases(data, rowStride, colStride) is true when
+// some operand reads the storage at data with other strides than those
+// given, which the destination then has to evaluate into a temporary.
+// Nodes keep Matrix operands by reference, so an expression must not
+// outlive the matrices it was built from.
+
+#include "MatrixConfig.h"
+
+class Matrix;
+
+template<class E>
+struct MatrixExpr {
+	const E& self() const { return static_cast<const E&>(*this); }
+};
+
+// how a node stores an operand: matrices by reference, nodes by value
+template<class E>
+struct MatrixExprRef {
+	typedef const E type;
+};
+template<>
+struct MatrixExprRef<Matrix> {
+	typedef const Matrix& type;
+};
+
+template<class L, class R>
+struct MatrixSum : public MatrixExpr<MatrixSum<L, R> > {
+	MatrixSum(const L& l, const R& r) : l(l), r(r), m(l.m), n(l.n) {}
+	double get(mdim_t i, mdim_t j) const { return l.get(i, j) + r.get(i, j); }
+	double at(msize_t k) const { return l.at(k) + r.at(k); }
+	bool rowMajor() const { return l.rowMajor() && r.rowMajor(); }
+	bool aliases(const double* p, int rs, int cs) const { return l.aliases(p, rs, cs) || r.aliases(p, rs, cs); }
+	typename MatrixExprRef<L>::type l;
+	typename MatrixExprRef<R>::type r;
+	mdim_t m;
+	mdim_t n;
+};
+
+template<class L, class R>
+struct MatrixDifference : public MatrixExpr<MatrixDifference<L, R> > {
+	MatrixDifference(const L& l, const R& r) : l(l), r(r), m(l.m), n(l.n) {}
+	double get(mdim_t i, mdim_t j) const { return l.get(i, j) - r.get(i, j); }
+	double at(msize_t k) const { return l.at(k) - r.at(k); }
+	bool rowMajor() const { return l.rowMajor() && r.rowMajor(); }
+	bool aliases(const double* p, int rs, int cs) const { return l.aliases(p, rs, cs) || r.aliases(p, rs, cs); }
+	typename MatrixExprRef<L>::type l;
+	typename MatrixExprRef<R>::type r;
+	mdim_t m;
+	mdim_t n;
+};
+
+// element-wise product
+template<class L, class R>
+struct MatrixProduct : public MatrixExpr<MatrixProduct<L, R> > {
+	MatrixProduct(const L& l, const R& r) : l(l), r(r), m(l.m), n(l.n) {}
+	double get(mdim_t i, mdim_t j) const { return l.get(i, j) * r.get(i, j); }
+	double at(msize_t k) const { return l.at(k) * r.at(k); }
+	bool rowMajor() const { return l.rowMajor() && r.rowMajor(); }
+	bool aliases(const double* p, int rs, int cs) const { return l.aliases(p, rs, cs) || r.aliases(p, rs, cs); }
+	typename MatrixExprRef<L>::type l;
+	typename MatrixExprRef<R>::type r;
+	mdim_t m;
+	mdim_t n;
+};
+
+template<class E>
+struct MatrixScale : public MatrixExpr<MatrixScale<E> > {
+	MatrixScale(const E& e, double scalar) : e(e), scalar(scalar), m(e.m), n(e.n) {}
+	double get(mdim_t i, mdim_t j) const { return e.get(i, j) * scalar; }
+	double at(msize_t k) const { return e.at(k) * scalar; }
+	bool rowMajor() const { return e.rowMajor(); }
+	bool aliases(const double* p, int rs, int cs) const { return e.aliases(p, rs, cs); }
+	typename MatrixExprRef<E>::type e;
+	double scalar;
+	mdim_t m;
+	mdim_t n;
+};
+
+template<class E>
+struct MatrixNegate : public MatrixExpr<MatrixNegate<E> > {
+	MatrixNegate(const E& e) : e(e), m(e.m), n(e.n) {}
+	double get(mdim_t i, mdim_t j) const { return -e.get(i, j); }
+	double at(msize_t k) const { return -e.at(k); }
+	bool rowMajor() const { return e.rowMajor(); }
+	bool aliases(const double* p, int rs, int cs) const { return e.aliases(p, rs, cs); }
+	typename MatrixExprRef<E>::type e;
+	mdim_t m;
+	mdim_t n;
+};
+
+// how an evaluated element is combined into its destination
+struct MatrixAssign { void operator()(double& a, double b) const { a = b; } };
+struct MatrixAddAssign { void operator()(double& a, double b) const { a += b; } };
+struct MatrixSubAssign { void operator()(double& a, double b) const { a -= b; } };
+struct MatrixMulAssign { void operator()(double& a, double b) const { a *= b; } };
+
+template<class L, class R>
+inline MatrixSum<L, R> operator+(const MatrixExpr<L>& l, const MatrixExpr<R>& r) {
+	return MatrixSum<L, R>(l.self(), r.self());
+}
+
+template<class L, class R>
+inline MatrixDifference<L, R> operator-(const MatrixExpr<L>& l, const MatrixExpr<R>& r) {
+	return MatrixDifference<L, R>(l.self(), r.self());
+}
+
+template<class E>
+inline MatrixNegate<E> operator-(const MatrixExpr<E>& e) {
+	return MatrixNegate<E>(e.self());
+}
+
+template<class E>
+inline MatrixScale<E> operator*(const MatrixExpr<E>& e, double scalar) {
+	return MatrixScale<E>(e.self(), scalar);
+}
+
+template<class E>
+inline MatrixScale<E> operator*(double scalar, const MatrixExpr<E>& e) {
+	return MatrixScale<E>(e.self(), scalar);
+}
+
+// element-wise product, the free form of Matrix::multiply
+template<class L, class R>
+inline MatrixProduct<L, R> multiply(const MatrixExpr<L>& l, const MatrixExpr<R>& r) {
+	return MatrixProduct<L, R>(l.self(), r.self());
+}
+
+#endif /* MATRIXEXPR_H_ */
@@ -0,0 +1,126 @@
+#ifndef MATRIXSIMD_H_
+#define MATRIXSIMD_H_
+
+// Thin wrapper over the widest double vector the target was compiled for
+// (AVX, SSE2 or plain scalar). Kernels are written once against simd_d and
+// pick up the instruction set from the compiler flags, e.g. -mavx2 -mfma.
+// Loads and stores are unaligned. simd_f is the float vector of the same
+// size (SIMD_WIDTH_F lanes) with just the multiply-add subset, overloaded
+// on the element type so templated kernels can use either.
+
+#if defined(__AVX__)
+#include <immintrin.h>
+
+struct simd_d { __m256d v; };
+enum { SIMD_WIDTH = 4 };
+
+static inline simd_d simd_load(const double* p) { simd_d r; r.v = _mm256_loadu_pd(p); return r; }
+static inline void simd_store(double* p, simd_d a) { _mm256_storeu_pd(p, a.v); }
+static inline simd_d simd_set1(double x) { simd_d r; r.v = _mm256_set1_pd(x); return r; }
+static inline simd_d simd_add(simd_d a, simd_d b) { simd_d r; r.v = _mm256_add_pd(a.v, b.v); return r; }
+static inline simd_d simd_sub(simd_d a, simd_d b) { simd_d r; r.v = _mm256_sub_pd(a.v, b.v); return r; }
+static inline simd_d simd_mul(simd_d a, simd_d b) { simd_d r; r.v = _mm256_mul_pd(a.v, b.v); return r; }
+static inline simd_d simd_div(simd_d a, simd_d b) { simd_d r; r.v = _mm256_div_pd(a.v, b.v); return r; }
+static inline simd_d simd_sqrt(simd_d a) { simd_d r; r.v = _mm256_sqrt_pd(a.v); return r; }
+static inline simd_d simd_max(simd_d a, simd_d b) { simd_d r; r.v = _mm256_max_pd(a.v, b.v); return r; }
+// a in the lanes where m > 0, 0 in the others (including NaN m)
+static inline simd_d simd_where_positive(simd_d m, simd_d a) { simd_d r; r.v = _mm256_and_pd(_mm256_cmp_pd(m.v, _mm256_setzero_pd(), _CMP_GT_OQ), a.v); return r; }
+#if defined(__FMA__)
+static inline simd_d simd_fmadd(simd_d a, simd_d b, simd_d c) { simd_d r; r.v = _mm256_fmadd_pd(a.v, b.v, c.v); return r; }
+#else
+static inline simd_d simd_fmadd(simd_d a, simd_d b, simd_d c) { return simd_add(simd_mul(a, b), c); }
+#endif
+
+struct simd_f { __m256 v; };
+enum { SIMD_WIDTH_F = 8 };
+
+static inline simd_f simd_load(const float* p) { simd_f r; r.v = _mm256_loadu_ps(p); return r; }
+static inline void simd_store(float* p, simd_f a) { _mm256_storeu_ps(p, a.v); }
+static inline simd_f simd_set1(float x) { simd_f r; r.v = _mm256_set1_ps(x); return r; }
+#if defined(__FMA__)
+static inline simd_f simd_fmadd(simd_f a, simd_f b, simd_f c) { simd_f r; r.v = _mm256_fmadd_ps(a.v, b.v, c.v); return r; }
+#else
+static inline simd_f simd_fmadd(simd_f a, simd_f b, simd_f c) { simd_f r; r.v = _mm256_add_ps(_mm256_mul_ps(a.v, b.v), c.v); return r; }
+#endif
+
+// transposes the SIMD_WIDTH x SIMD_WIDTH tile held in r[0..SIMD_WIDTH-1] (one row per register)
+static inline void simd_transpose(simd_d* r) {
+	__m256d t0 = _mm256_unpacklo_pd(r[0].v, r[1].v);
+	__m256d t1 = _mm256_unpackhi_pd(r[0].v, r[1].v);
+	__m256d t2 = _mm256_unpacklo_pd(r[2].v, r[3].v);
+	__m256d t3 = _mm256_unpackhi_pd(r[2].v, r[3].v);
+	r[0].v = _mm256_permute2f128_pd(t0, t2, 0x20);
+	r[1].v = _mm256_permute2f128_pd(t1, t3, 0x20);
+	r[2].v = _mm256_permute2f128_pd(t0, t2, 0x31);
+	r[3].v = _mm256_permute2f128_pd(t1, t3, 0x31);
+}
+
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+
+struct simd_d { __m128d v; };
+enum { SIMD_WIDTH = 2 };
+
+static inline simd_d simd_load(const double* p) { simd_d r; r.v = _mm_loadu_pd(p); return r; }
+static inline void simd_store(double* p, simd_d a) { _mm_storeu_pd(p, a.v); }
+static inline simd_d simd_set1(double x) { simd_d r; r.v = _mm_set1_pd(x); return r; }
+static inline simd_d simd_add(simd_d a, simd_d b) { simd_d r; r.v = _mm_add_pd(a.v, b.v); return r; }
+static inline simd_d simd_sub(simd_d a, simd_d b) { simd_d r; r.v = _mm_sub_pd(a.v, b.v); return r; }
+static inline simd_d simd_mul(simd_d a, simd_d b) { simd_d r; r.v = _mm_mul_pd(a.v, b.v); return r; }
+static inline simd_d simd_div(simd_d a, simd_d b) { simd_d r; r.v = _mm_div_pd(a.v, b.v); return r; }
+static inline simd_d simd_sqrt(simd_d a) { simd_d r; r.v = _mm_sqrt_pd(a.v); return r; }
+static inline simd_d simd_max(simd_d a, simd_d b) { simd_d r; r.v = _mm_max_pd(a.v, b.v); return r; }
+static inline simd_d simd_where_positive(simd_d m, simd_d a) { simd_d r; r.v = _mm_and_pd(_mm_cmpgt_pd(m.v, _mm_setzero_pd()), a.v); return r; }
+static inline simd_d simd_fmadd(simd_d a, simd_d b, simd_d c) { return simd_add(simd_mul(a, b), c); }
+
+struct simd_f { __m128 v; };
+enum { SIMD_WIDTH_F = 4 };
+
+static inline simd_f simd_load(const float* p) { simd_f r; r.v = _mm_loadu_ps(p); return r; }
+static inline void simd_store(float* p, simd_f a) { _mm_storeu_ps(p, a.v); }
+static inline simd_f simd_set1(float x) { simd_f r; r.v = _mm_set1_ps(x); return r; }
+static inline simd_f simd_fmadd(simd_f a, simd_f b, simd_f c) { simd_f r; r.v = _mm_add_ps(_mm_mul_ps(a.v, b.v), c.v); return r; }
+
+static inline void simd_transpose(simd_d* r) {
+	__m128d t = _mm_unpacklo_pd(r[0].v, r[1].v);
+	r[1].v = _mm_unpackhi_pd(r[0].v, r[1].v);
+	r[0].v = t;
+}
+
+#else
+#include <math.h>
+
+struct simd_d { double v; };
+enum { SIMD_WIDTH = 1 };
+
+static inline simd_d simd_load(const double* p) { simd_d r; r.v = *p; return r; }
+static inline void simd_store(double* p, simd_d a) { *p = a.v; }
+static inline simd_d simd_set1(double x) { simd_d r; r.v = x; return r; }
+static inline simd_d simd_add(simd_d a, simd_d b) { simd_d r; r.v = a.v + b.v; return r; }
+static inline simd_d simd_sub(simd_d a, simd_d b) { simd_d r; r.v = a.v - b.v; return r; }
+static inline simd_d simd_mul(simd_d a, simd_d b) { simd_d r; r.v = a.v * b.v; return r; }
+static inline simd_d simd_div(simd_d a, simd_d b) { simd_d r; r.v = a.v / b.v; return r; }
+static inline simd_d simd_sqrt(simd_d a) { simd_d r; r.v = sqrt(a.v); return r; }
+static inline simd_d simd_max(simd_d a, simd_d b) { simd_d r; r.v = a.v > b.v ? a.v : b.v; return r; }
+static inline simd_d simd_where_positive(simd_d m, simd_d a) { simd_d r; r.v = m.v > 0.0 ? a.v : 0.0; return r; }
+static inline simd_d simd_fmadd(simd_d a, simd_d b, simd_d c) { simd_d r; r.v = a.v * b.v + c.v; return r; }
+static inline void simd_transpose(simd_d*) {}
+
+struct simd_f { float v; };
+enum { SIMD_WIDTH_F = 1 };
+
+static inline simd_f simd_load(const float* p) { simd_f r; r.v = *p; return r; }
+static inline void simd_store(float* p, simd_f a) { *p = a.v; }
+static inline simd_f simd_set1(float x) { simd_f r; r.v = x; return r; }
+static inline simd_f simd_fmadd(simd_f a, simd_f b, simd_f c) { simd_f r; r.v = a.v * b.v + c.v; return r; }
+
+#endif
+
+// operator forms, so formulas written for double (SmallKernels.h) also run
+// on simd_d
+static inline simd_d operator+(simd_d a, simd_d b) { return simd_add(a, b); }
+static inline simd_d operator-(simd_d a, simd_d b) { return simd_sub(a, b); }
+static inline simd_d operator*(simd_d a, simd_d b) { return simd_mul(a, b); }
+static inline simd_d operator-(simd_d a) { return simd_sub(simd_set1(0.0), a); }
+
+#endif /* MATRIXSIMD_H_ */
@@ -0,0 +1,92 @@
+#include "MatrixStats.h"
+#include <stdio.h>
+
+static MatrixStats counters;
+
+static const char* opNames[MATRIX_OP_COUNT] = {
+	"dot",
+	"inverse",
+	"quaternion_multiply",
+	"quaternion_inverse",
+	"quaternion_rotate",
+	"copyMatrix",
+	"qr"
+};
+
+#ifdef MATRIX_STATS
+void matrix_stats_allocate(size_t bytes) {
+	counters.allocations++;
+	counters.bytesAllocated += bytes;
+	counters.liveBytes += bytes;
+	if (counters.liveBytes > counters.peakBytes)
+		counters.peakBytes = counters.liveBytes;
+}
+
+void matrix_stats_release(size_t bytes) {
+	counters.releases++;
+	counters.liveBytes -= bytes;
+}
+
+void matrix_stats_op(MatrixOp op, double flops) {
+	counters.calls[op]++;
+	counters.flops[op] += flops;
+}
+#endif
+
+bool MatrixStats::enabled() {
+#ifdef MATRIX_STATS
+	return true;
+#else
+	return false;
+#endif
+}
+
+MatrixStats MatrixStats::snapshot() {
+	return counters;
+}
+
+void MatrixStats::reset() {
+	counters.allocations = 0;
+	counters.releases = 0;
+	counters.bytesAllocated = 0;
+	counters.peakBytes = counters.liveBytes;
+	for (int i=0; i<MATRIX_OP_COUNT; i++) {
+		counters.calls[i] = 0;
+		counters.flops[i] = 0.0;
+	}
+}
+
+const char* MatrixStats::opName(MatrixOp op) {
+	return op >= 0 && op < MATRIX_OP_COUNT ? opNames[op] : "";
+}
+
+MatrixStats MatrixStats::since(const MatrixStats& before) const {
+	MatrixStats result = *this;
+	result.allocations -= before.allocations;
+	result.releases -= before.releases;
+	result.bytesAllocated -= before.bytesAllocated;
+	for (int i=0; i<MATRIX_OP_COUNT; i++) {
+		result.calls[i] -= before.calls[i];
+		result.flops[i] -= before.flops[i];
+	}
+	return result;
+}
+
+int MatrixStats::toJson(char* buffer, size_t size) const {
+	int total = 0;
+	int len = snprintf(buffer, size,
+			"{\"enabled\":%s,\"allocations\":%lu,\"releases\":%lu,"
+			"\"bytes\":%lu,\"live_bytes\":%lu,\"peak_bytes\":%lu,\"ops\":{",
+			enabled() ? "true" : "false", allocations, releases,
+			(unsigned long)bytesAllocated, (unsigned long)liveBytes, (unsigned long)peakBytes);
+	for (int i=0; len >= 0 && i<=MATRIX_OP_COUNT; i++) {
+		total += len;
+		size_t used = (size_t)total < size ? total : size;
+		if (i == MATRIX_OP_COUNT)
+			len = snprintf(buffer + used, size - used, "}}");
+		else
+			len = snprintf(buffer + used, size - used, "%s\"%s\":{\"calls\":%lu,\"flops\":%.0f}",
+					i ? "," : "", opNames[i], calls[i], flops[i]);
+	}
+	return len < 0 ? len : total + len;
+}
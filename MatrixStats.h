@@ -0,0 +1,56 @@
+#ifndef MATRIXSTATS_H_
+#define MATRIXSTATS_H_
+
+#include <stddef.h>
+
+// Instrumentation, compiled in only with -DMATRIX_STATS. Without it the
+// hooks below expand to nothing and the counters stay zero, so the
+// snapshot/reset/JSON API can be called unconditionally.
+
+enum MatrixOp {
+	MATRIX_OP_DOT,
+	MATRIX_OP_INVERSE,
+	MATRIX_OP_QUATERNION_MULTIPLY,
+	MATRIX_OP_QUATERNION_INVERSE,
+	MATRIX_OP_QUATERNION_ROTATE,
+	MATRIX_OP_COPY,
+	MATRIX_OP_QR,
+	MATRIX_OP_COUNT
+};
+
+struct MatrixStats {
+	unsigned long allocations;
+	unsigned long releases;
+	size_t bytesAllocated; // total over all allocations
+	size_t liveBytes;
+	size_t peakBytes;
+	unsigned long calls[MATRIX_OP_COUNT];
+	double flops[MATRIX_OP_COUNT];
+
+	static bool enabled();
+	static MatrixStats snapshot();
+	// clears everything, peakBytes restarts from the current live bytes
+	static void reset();
+	static const char* opName(MatrixOp op);
+
+	// counters accumulated since an earlier snapshot; live and peak bytes are kept as is
+	MatrixStats since(const MatrixStats& before) const;
+	// writes a JSON object into buffer (always terminated if size > 0),
+	// returns the length snprintf would have needed
+	int toJson(char* buffer, size_t size) const;
+};
+
+#ifdef MATRIX_STATS
+void matrix_stats_allocate(size_t bytes);
+void matrix_stats_release(size_t bytes);
+void matrix_stats_op(MatrixOp op, double flops);
+#define MATRIX_STATS_ALLOCATE(bytes) matrix_stats_allocate(bytes)
+#define MATRIX_STATS_RELEASE(bytes) matrix_stats_release(bytes)
+#define MATRIX_STATS_OP(op, flops) matrix_stats_op(op, flops)
+#else
+#define MATRIX_STATS_ALLOCATE(bytes) ((void)0)
+#define MATRIX_STATS_RELEASE(bytes) ((void)0)
+#define MATRIX_STATS_OP(op, flops) ((void)0)
+#endif
+
+#endif /* MATRIXSTATS_H_ */
@@ -0,0 +1,99 @@
+#include "MatrixView.h"
+#include "Gemm.h"
+#include "MatrixStats.h"
+#include <math.h>
+
+MatrixView::MatrixView(double* data, mdim_t m, mdim_t n, int rowStride, int colStride) {
+	this->data = data;
+	this->m = m;
+	this->n = n;
+	this->rowStride = rowStride;
+	this->colStride = colStride;
+}
+
+MatrixView::MatrixView(const Matrix& a) {
+	data = a.data;
+	m = a.m;
+	n = a.n;
+	// honour the lazy transpose the same way Matrix::index does
+	rowStride = a.isTransposed ? 1 : a.n;
+	colStride = a.isTransposed ? a.m : 1;
+}
+
+MatrixView MatrixView::submatrix(mdim_t row_top, mdim_t col_left, mdim_t row_bottom, mdim_t col_right) const {
+	return MatrixView(&set(row_top, col_left), row_bottom-row_top+1, col_right-col_left+1, rowStride, colStride);
+}
+
+MatrixView MatrixView::row(mdim_t i) const {
+	return MatrixView(&set(i, 0), 1, n, rowStride, colStride);
+}
+
+MatrixView MatrixView::column(mdim_t j) const {
+	return MatrixView(&set(0, j), m, 1, rowStride, colStride);
+}
+
+MatrixView MatrixView::diagonal() const {
+	return MatrixView(data, m < n ? m : n, 1, rowStride + colStride, colStride);
+}
+
+MatrixView MatrixView::transposed() const {
+	return MatrixView(data, n, m, colStride, rowStride);
+}
+
+MatrixView& MatrixView::operator=(const MatrixView& rhs) {
+	return *this = static_cast<const MatrixExpr<MatrixView>&>(rhs);
+}
+
+MatrixView& MatrixView::operator*=(double scalar) {
+	for (mdim_t i=0; i<m; i++)
+		for (mdim_t j=0; j<n; j++)
+			set(i, j) *= scalar;
+	return *this;
+}
+
+Matrix MatrixView::dot(const MatrixView& rhs, bool left) const {
+	const MatrixView& a = left ? rhs : *this;
+	const MatrixView& b = left ? *this : rhs;
+	if (a.n != b.m)
+		return Matrix(0, 0);
+	MATRIX_STATS_OP(MATRIX_OP_DOT, 2.0 * a.m * a.n * b.n);
+	Matrix result(a.m, b.n);
+	if ((double)a.m * a.n * b.n >= MATRIX_GEMM_THRESHOLD) {
+		gemm(a.m, b.n, a.n, 1.0,
+				a.data, a.rowStride, a.colStride,
+				b.data, b.rowStride, b.colStride,
+				0.0, result.data, result.n, 1);
+		return result;
+	}
+	for (mdim_t i=0; i<a.m; i++)
+		for (mdim_t j=0; j<b.n; j++) {
+			double acc = 0.0;
+			for (mdim_t k=0; k<a.n; k++)
+				acc += a.get(i, k) * b.get(k, j);
+			result(i, j) = acc;
+		}
+	return result;
+}
+
+double MatrixView::norm() const {
+	double result = 0.0;
+	for (mdim_t i=0; i<m; i++)
+		for (mdim_t j=0; j<n; j++)
+			result += get(i, j) * get(i, j);
+	return sqrt(result);
+}
+
+double MatrixView::sum() const {
+	double result = 0.0;
+	for (mdim_t i=0; i<m; i++)
+		for (mdim_t j=0; j<n; j++)
+			result += get(i, j);
+	return result;
+}
+
+double MatrixView::trace() const {
+	double result = 0.0;
+	for (mdim_t i=0; i<m && i<n; i++)
+		result += get(i, i);
+	return result;
+}
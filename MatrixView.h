@@ -0,0 +1,93 @@
+#ifndef MATRIXVIEW_H_
+#define MATRIXVIEW_H_
+
+#include "Matrix.h"
+#include <stddef.h>
+
+// Non-owning strided window onto Matrix storage: element (i, j) lives at
+// data[i * rowStride + j * colStride]. Blocks, rows, columns, the diagonal
+// and transposes only differ in offset and strides, so none of them copies.
+//
+// A view must not outlive the Matrix it looks into; building one from a
+// temporary Matrix does not compile. Assigning to a view writes through
+// to the viewed elements, it does not rebind the view. As with Matrix,
+// the right hand side must not overlap the view unless it is the same
+// element (v += v is fine, v = v.transposed() is not).
+class MatrixView : public MatrixExpr<MatrixView> {
+public:
+	MatrixView(double* data, mdim_t m, mdim_t n, int rowStride, int colStride);
+	MatrixView(const Matrix& a);
+	MatrixView(Matrix&& a) = delete;
+	// copies the view, not the elements
+	MatrixView(const MatrixView& rhs) = default;
+
+	// same inclusive corners as Matrix::submatrix
+	MatrixView submatrix(mdim_t row_top, mdim_t col_left, mdim_t row_bottom, mdim_t col_right) const;
+	MatrixView row(mdim_t i) const;       // 1 x n
+	MatrixView column(mdim_t j) const;    // m x 1
+	MatrixView diagonal() const;          // min(m, n) x 1
+	MatrixView transposed() const;
+
+	MatrixView& operator=(const MatrixView& rhs);
+	template<class E> MatrixView& operator=(const MatrixExpr<E>& expr);
+	template<class E> MatrixView& operator+=(const MatrixExpr<E>& expr);
+	template<class E> MatrixView& operator-=(const MatrixExpr<E>& expr);
+	MatrixView& operator*=(double scalar);
+
+	// left: rhs * this, otherwise this * rhs (as Matrix::dot)
+	Matrix dot(const MatrixView& rhs, bool left=false) const;
+	double norm() const;
+	double sum() const;
+	double trace() const;
+
+	double& operator()(mdim_t i, mdim_t j=0) const { return data[(ptrdiff_t)i * rowStride + (ptrdiff_t)j * colStride]; }
+	const double& get(mdim_t i, mdim_t j) const { return data[(ptrdiff_t)i * rowStride + (ptrdiff_t)j * colStride]; }
+	double& set(mdim_t i, mdim_t j) const { return data[(ptrdiff_t)i * rowStride + (ptrdiff_t)j * colStride]; }
+	// expression interface: linear access, valid when rowMajor()
+	double at(msize_t k) const { return data[k]; }
+	bool rowMajor() const { return colStride == 1 && rowStride == (int)n; }
+	bool aliases(const double* p, int rs, int cs) const {
+		return data == p && (rs != rowStride || cs != colStride);
+	}
+
+	double* data;
+	mdim_t m;
+	mdim_t n;
+	int rowStride;
+	int colStride;
+};
+
+template<class E>
+MatrixView& MatrixView::operator=(const MatrixExpr<E>& expr) {
+	const E& e = expr.self();
+	if (e.m != m || e.n != n)
+		return *this;
+	for (mdim_t i=0; i<m; i++)
+		for (mdim_t j=0; j<n; j++)
+			set(i, j) = e.get(i, j);
+	return *this;
+}
+
+template<class E>
+MatrixView& MatrixView::operator+=(const MatrixExpr<E>& expr) {
+	const E& e = expr.self();
+	if (e.m != m || e.n != n)
+		return *this;
+	for (mdim_t i=0; i<m; i++)
+		for (mdim_t j=0; j<n; j++)
+			set(i, j) += e.get(i, j);
+	return *this;
+}
+
+template<class E>
+MatrixView& MatrixView::operator-=(const MatrixExpr<E>& expr) {
+	const E& e = expr.self();
+	if (e.m != m || e.n != n)
+		return *this;
+	for (mdim_t i=0; i<m; i++)
+		for (mdim_t j=0; j<n; j++)
+			set(i, j) -= e.get(i, j);
+	return *this;
+}
+
+#endif /* MATRIXVIEW_H_ */
@@ -0,0 +1,162 @@
+#include "Parallel.h"
+
+double MatrixParallel::dotThreshold = 2.0e6;
+msize_t MatrixParallel::elementwiseThreshold = 1 << 18;
+msize_t MatrixParallel::reductionThreshold = 1 << 18;
+msize_t MatrixParallel::reductionGrain = 1 << 14;
+
+#ifdef MATRIX_PARALLEL
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+// Persistent workers woken per run() by bumping generation. Chunks are
+// handed out through an atomic counter; run() returns when every chunk
+// is done and no worker is still looking at the current job.
+struct Pool {
+	std::mutex lock;
+	std::mutex runLock; // one job at a time
+	std::condition_variable wake;
+	std::condition_variable idle;
+	std::thread* workers;
+	unsigned int count;
+	unsigned long generation;
+	bool stop;
+
+	ParallelTask task;
+	void* context;
+	msize_t chunks;
+	std::atomic<msize_t> next;
+	msize_t done;
+	unsigned int active;
+
+	Pool() : workers(0), count(0), generation(0), stop(false),
+			task(0), context(0), chunks(0), next(0), done(0), active(0) {}
+	~Pool() { resize(0); }
+
+	void resize(unsigned int workerCount);
+	void work();
+	msize_t drain(ParallelTask t, void* c, msize_t n);
+};
+
+static Pool pool;
+static bool configured = false;
+static thread_local bool insideTask = false;
+
+msize_t Pool::drain(ParallelTask t, void* c, msize_t n) {
+	msize_t finished = 0;
+	insideTask = true;
+	for (msize_t k = next++; k < n; k = next++) {
+		t(c, k);
+		finished++;
+	}
+	insideTask = false;
+	return finished;
+}
+
+void Pool::work() {
+	std::unique_lock<std::mutex> guard(lock);
+	unsigned long seen = generation; // only jobs started from now on
+	for (;;) {
+		wake.wait(guard, [&] { return stop || generation != seen; });
+		if (stop)
+			return;
+		seen = generation;
+		ParallelTask t = task;
+		void* c = context;
+		msize_t n = chunks;
+		active++;
+		guard.unlock();
+		msize_t finished = drain(t, c, n);
+		guard.lock();
+		done += finished;
+		active--;
+		idle.notify_all();
+	}
+}
+
+void Pool::resize(unsigned int workerCount) {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stop = true;
+	}
+	wake.notify_all();
+	for (unsigned int i=0; i<count; i++)
+		workers[i].join();
+	delete[] workers;
+	workers = 0;
+	count = 0;
+	stop = false;
+	if (!workerCount)
+		return;
+	workers = new std::thread[workerCount];
+	count = workerCount;
+	for (unsigned int i=0; i<count; i++)
+		workers[i] = std::thread(&Pool::work, this);
+}
+
+}
+
+void MatrixParallel::run(msize_t chunks, ParallelTask task, void* context) {
+	if (!configured)
+		setThreads(0);
+	if (chunks == 1 || pool.count == 0 || insideTask) {
+		for (msize_t k=0; k<chunks; k++)
+			task(context, k);
+		return;
+	}
+
+	std::lock_guard<std::mutex> runGuard(pool.runLock);
+	{
+		std::unique_lock<std::mutex> guard(pool.lock);
+		// a late worker may still be leaving the previous job
+		pool.idle.wait(guard, [] { return pool.active == 0; });
+		pool.task = task;
+		pool.context = context;
+		pool.chunks = chunks;
+		pool.next = 0;
+		pool.done = 0;
+		pool.generation++;
+	}
+	pool.wake.notify_all();
+
+	msize_t finished = pool.drain(task, context, chunks);
+	std::unique_lock<std::mutex> guard(pool.lock);
+	pool.done += finished;
+	pool.idle.wait(guard, [] { return pool.done == pool.chunks && pool.active == 0; });
+}
+
+void MatrixParallel::setThreads(unsigned int count) {
+	if (!count)
+		count = std::thread::hardware_concurrency();
+	if (!count)
+		count = 1;
+	configured = true;
+	if (count - 1 != pool.count)
+		pool.resize(count - 1);
+}
+
+unsigned int MatrixParallel::threads() {
+	if (!configured)
+		setThreads(0);
+	return pool.count + 1;
+}
+
+#else
+
+void MatrixParallel::run(msize_t chunks, ParallelTask task, void* context) {
+	for (msize_t k=0; k<chunks; k++)
+		task(context, k);
+}
+
+void MatrixParallel::setThreads(unsigned int) {
+}
+
+unsigned int MatrixParallel::threads() {
+	return 1;
+}
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef PARALLEL_H_
+#define PARALLEL_H_
+
+#include "MatrixConfig.h"
+
+// Optional fork-join backend for large operations, compiled in with
+// -DMATRIX_PARALLEL (it needs std::thread, so it is not meant for AVR).
+// Without it run() executes every chunk on the caller and the thresholds
+// are never consulted.
+//
+// Work is always split into the same chunks for a given size, whatever
+// the thread count; reductions combine per-chunk partials in chunk order,
+// so results are bit-identical from 1 to N threads. Workers never
+// allocate: any scratch a chunk needs is set up by the caller first.
+
+// processes chunk number 'chunk' of the work described by context
+typedef void (*ParallelTask)(void* context, msize_t chunk);
+
+class MatrixParallel {
+public:
+	// runs task(context, c) for every c in [0, chunks) and returns once all
+	// are done; the calling thread takes chunks too. Calls made from inside
+	// a task run inline.
+	static void run(msize_t chunks, ParallelTask task, void* context);
+
+	// total threads including the caller, 0 picks one per hardware thread
+	static void setThreads(unsigned int count);
+	static unsigned int threads();
+
+	// multiply-adds (m * n * k) from which gemm splits C across threads
+	static double dotThreshold;
+	// elements from which +=, -=, multiplySelf and *= split by rows
+	static msize_t elementwiseThreshold;
+	// elements from which norm and sum use chunked partial sums
+	static msize_t reductionThreshold;
+	// elements per reduction chunk, fixed so the summation order is too
+	static msize_t reductionGrain;
+};
+
+#endif /* PARALLEL_H_ */
@@ -0,0 +1,379 @@
+#include "QR.h"
+#include "Gemm.h"
+#include "MatrixAllocator.h"
+#include "MatrixStats.h"
+#include <math.h>
+
+// Applies H_j^T ... H_{j+nb-1}^T = (I - Y T Y^T)^T to the rows j.. of C,
+// where Y holds the reflectors j .. j+nb-1 of the m x n factor a. C has
+// nc columns and is addressed as c[i * rsc + l * csc] from row j on.
+// work needs (m - j) * nb + nb * nb + nb * nc doubles.
+static void apply_block(const double* a, mdim_t m, mdim_t n, const double* tau, mdim_t j, mdim_t nb,
+		double* c, int rsc, int csc, mdim_t nc, double* work) {
+	mdim_t rows = m - j;
+	double* Y = work;
+	double* T = Y + (msize_t)rows * nb;
+	double* W = T + (msize_t)nb * nb;
+
+	// Y with its unit diagonal and zeros above spelled out, so it can go
+	// straight into gemm
+	for (mdim_t r=0; r<rows; r++)
+		for (mdim_t p=0; p<nb; p++)
+			Y[(msize_t)r * nb + p] = r < p ? 0.0 : r == p ? 1.0 : a[(msize_t)(j + r) * n + j + p];
+
+	// upper triangular T with H_j ... H_{j+nb-1} = I - Y T Y^T
+	for (mdim_t i=0; i<nb; i++) {
+		double t = tau[j + i];
+		T[(msize_t)i * nb + i] = t;
+		for (mdim_t p=0; p<i; p++) {
+			double z = 0.0;
+			for (mdim_t r=i; r<rows; r++)
+				z += Y[(msize_t)r * nb + p] * Y[(msize_t)r * nb + i];
+			W[p] = z;
+		}
+		for (mdim_t p=0; p<i; p++) {
+			double acc = 0.0;
+			for (mdim_t q=p; q<i; q++)
+				acc += T[(msize_t)p * nb + q] * W[q];
+			T[(msize_t)p * nb + i] = -t * acc;
+		}
+	}
+
+	// W = Y^T C
+	bool large = (double)rows * nc * nb >= MATRIX_GEMM_THRESHOLD;
+	if (large)
+		gemm(nb, nc, rows, 1.0, Y, 1, nb, c, rsc, csc, 0.0, W, nc, 1);
+	else {
+		for (msize_t i=0; i<(msize_t)nb * nc; i++)
+			W[i] = 0.0;
+		for (mdim_t r=0; r<rows; r++)
+			for (mdim_t p=0; p<nb && p<=r; p++) {
+				double y = Y[(msize_t)r * nb + p];
+				for (mdim_t l=0; l<nc; l++)
+					W[(msize_t)p * nc + l] += y * c[(ptrdiff_t)r * rsc + (ptrdiff_t)l * csc];
+			}
+	}
+
+	// W = T^T W, bottom up so every row still reads the rows above it unchanged
+	for (mdim_t i=nb; i-- > 0; )
+		for (mdim_t l=0; l<nc; l++) {
+			double acc = 0.0;
+			for (mdim_t p=0; p<=i; p++)
+				acc += T[(msize_t)p * nb + i] * W[(msize_t)p * nc + l];
+			W[(msize_t)i * nc + l] = acc;
+		}
+
+	// C -= Y W
+	if (large)
+		gemm(rows, nc, nb, -1.0, Y, nb, 1, W, nc, 1, 1.0, c, rsc, csc);
+	else
+		for (mdim_t r=0; r<rows; r++)
+			for (mdim_t l=0; l<nc; l++) {
+				double acc = 0.0;
+				for (mdim_t p=0; p<nb && p<=r; p++)
+					acc += Y[(msize_t)r * nb + p] * W[(msize_t)p * nc + l];
+				c[(ptrdiff_t)r * rsc + (ptrdiff_t)l * csc] -= acc;
+			}
+}
+
+// 2-norm of a strided column; the plain sum of squares unless it over- or
+// underflows, then again with the entries scaled by the largest one
+static double column_norm(const double* p, mdim_t count, msize_t stride) {
+	double sum = 0.0;
+	for (mdim_t i=0; i<count; i++)
+		sum += p[i * stride] * p[i * stride];
+	if (sum > 1.0e-280 && sum < 1.0e280)
+		return sqrt(sum);
+	double scale = 0.0;
+	for (mdim_t i=0; i<count; i++)
+		if (fabs(p[i * stride]) > scale)
+			scale = fabs(p[i * stride]);
+	if (scale == 0.0)
+		return 0.0;
+	sum = 0.0;
+	for (mdim_t i=0; i<count; i++)
+		sum += (p[i * stride] / scale) * (p[i * stride] / scale);
+	return scale * sqrt(sum);
+}
+
+static inline mdim_t block_size(mdim_t n) {
+	return n < MATRIX_QR_BLOCK ? n : MATRIX_QR_BLOCK;
+}
+
+QR::QR() {
+	ok = false;
+}
+
+QR::QR(const Matrix& A) {
+	ok = false;
+	factor(A);
+}
+
+bool QR::factor(const Matrix& A) {
+	ok = false;
+	mdim_t m = A.m, n = A.n;
+	if (m < n || n == 0)
+		return false;
+	MATRIX_STATS_OP(MATRIX_OP_QR, 2.0 * n * n * (m - n / 3.0));
+	if (qr.m != m || qr.n != n || qr.isTransposed || !qr.isAllocated)
+		qr = Matrix(m, n);
+	if (tau.m != n || tau.n != 1)
+		tau = Matrix(n, 1);
+	double* a = qr.data;
+	for (mdim_t i=0; i<m; i++)
+		for (mdim_t j=0; j<n; j++)
+			a[(msize_t)i * n + j] = A.get(i, j);
+
+	mdim_t nbMax = block_size(n);
+	msize_t workSize = (msize_t)m * nbMax + (msize_t)nbMax * nbMax + (msize_t)nbMax * n;
+	MatrixAllocator* allocator = MatrixAllocator::current();
+	double* work = n > nbMax ? (double*)allocator->allocate(workSize * sizeof(double)) : 0;
+
+	for (mdim_t j=0; j<n; j+=nbMax) {
+		mdim_t nb = block_size(n - j);
+		// unblocked panel: reflector for column c, applied to the rest of the panel
+		for (mdim_t c=j; c<j+nb; c++) {
+			double alpha = a[(msize_t)c * n + c];
+			double xnorm = column_norm(a + (msize_t)(c + 1) * n + c, m - c - 1, n);
+			if (xnorm == 0.0) {
+				tau.data[c] = 0.0;
+				continue;
+			}
+			double beta = alpha >= 0.0 ? -hypot(alpha, xnorm) : hypot(alpha, xnorm);
+			tau.data[c] = (beta - alpha) / beta;
+			double scale = 1.0 / (alpha - beta);
+			for (mdim_t r=c+1; r<m; r++)
+				a[(msize_t)r * n + c] *= scale;
+			a[(msize_t)c * n + c] = beta;
+
+			// s = tau * v^T A for the panel columns right of c, then A -= v s,
+			// each as one sweep down the rows
+			double s[MATRIX_QR_BLOCK];
+			double* top = a + (msize_t)c * n;
+			mdim_t width = j + nb - c - 1;
+			for (mdim_t q=0; q<width; q++)
+				s[q] = top[c + 1 + q];
+			for (mdim_t r=c+1; r<m; r++) {
+				const double* row = a + (msize_t)r * n;
+				for (mdim_t q=0; q<width; q++)
+					s[q] += row[c] * row[c + 1 + q];
+			}
+			for (mdim_t q=0; q<width; q++) {
+				s[q] *= tau.data[c];
+				top[c + 1 + q] -= s[q];
+			}
+			for (mdim_t r=c+1; r<m; r++) {
+				double* row = a + (msize_t)r * n;
+				for (mdim_t q=0; q<width; q++)
+					row[c + 1 + q] -= s[q] * row[c];
+			}
+		}
+		// trailing columns take the whole panel as one block reflector
+		if (j + nb < n)
+			apply_block(a, m, n, tau.data, j, nb, a + (msize_t)j * n + j + nb, n, 1, n - j - nb, work);
+	}
+	if (work)
+		allocator->release(work, workSize * sizeof(double));
+
+	// rank check relative to the largest diagonal entry of R
+	double biggest = 0.0;
+	for (mdim_t i=0; i<n; i++)
+		if (fabs(a[(msize_t)i * n + i]) > biggest)
+			biggest = fabs(a[(msize_t)i * n + i]);
+	double tolerance = biggest * m * 2.2e-16;
+	for (mdim_t i=0; i<n; i++)
+		if (!(fabs(a[(msize_t)i * n + i]) > tolerance))
+			return false;
+	ok = true;
+	return true;
+}
+
+bool QR::isFullRank() const {
+	return ok;
+}
+
+Matrix& QR::applyQt(Matrix& b) const {
+	mdim_t m = qr.m, n = qr.n;
+	if (!qr.data || b.m != m || b.n == 0)
+		return b;
+	int rsb = b.isTransposed ? 1 : b.n;
+	int csb = b.isTransposed ? b.m : 1;
+	mdim_t nbMax = block_size(n);
+	msize_t workSize = (msize_t)m * nbMax + (msize_t)nbMax * nbMax + (msize_t)nbMax * b.n;
+	MatrixAllocator* allocator = MatrixAllocator::current();
+	double* work = (double*)allocator->allocate(workSize * sizeof(double));
+	for (mdim_t j=0; j<n; j+=nbMax)
+		apply_block(qr.data, m, n, tau.data, j, block_size(n - j),
+				b.data + (ptrdiff_t)j * rsb, rsb, csb, b.n, work);
+	allocator->release(work, workSize * sizeof(double));
+	return b;
+}
+
+Matrix QR::solve(const Matrix& b) const {
+	mdim_t m = qr.m, n = qr.n;
+	if (!ok || b.m != m)
+		return Matrix(0, 0);
+	Matrix y(b);
+	applyQt(y);
+	// R x = (Q^T b)[0 .. n-1]
+	Matrix x(n, b.n);
+	const double* a = qr.data;
+	for (mdim_t l=0; l<b.n; l++)
+		for (mdim_t i=n; i-- > 0; ) {
+			double acc = y.get(i, l);
+			for (mdim_t k=i+1; k<n; k++)
+				acc -= a[(msize_t)i * n + k] * x.data[(msize_t)k * b.n + l];
+			x.data[(msize_t)i * b.n + l] = acc / a[(msize_t)i * n + i];
+		}
+	return x;
+}
+
+Matrix QR::R() const {
+	mdim_t n = qr.n;
+	Matrix result(n, n);
+	for (mdim_t i=0; i<n; i++)
+		for (mdim_t j=i; j<n; j++)
+			result(i, j) = qr.data[(msize_t)i * n + j];
+	return result;
+}
+
+Matrix QR::Q() const {
+	mdim_t m = qr.m, n = qr.n;
+	Matrix result(m, n);
+	for (mdim_t i=0; i<n; i++)
+		result(i, i) = 1.0;
+	// H_0 ... H_{n-1} applied to the first n columns of I, last reflector first
+	const double* a = qr.data;
+	for (mdim_t c=n; c-- > 0; )
+		for (mdim_t q=c; q<n; q++) {
+			double s = result(c, q);
+			for (mdim_t r=c+1; r<m; r++)
+				s += a[(msize_t)r * n + c] * result(r, q);
+			s *= tau.data[c];
+			result(c, q) -= s;
+			for (mdim_t r=c+1; r<m; r++)
+				result(r, q) -= s * a[(msize_t)r * n + c];
+		}
+	return result;
+}
+
+Matrix lstsq(const Matrix& A, const Matrix& b) {
+	QR qr(A);
+	return qr.solve(b);
+}
+
+IncrementalQR::IncrementalQR(mdim_t n, mdim_t k, double forgetting)
+		: R(n, n), QtB(n, k), forgetting(forgetting), work(1, n + k) {
+	rss = 0.0;
+	count = 0;
+}
+
+void IncrementalQR::addRow(const double* a, const double* b) {
+	mdim_t n = R.n, k = QtB.n;
+	double* w = work.data;
+	double* e = w + n;
+	for (mdim_t j=0; j<n; j++)
+		w[j] = a[j];
+	for (mdim_t l=0; l<k; l++)
+		e[l] = b[l];
+	MATRIX_STATS_OP(MATRIX_OP_QR, 6.0 * n * (n / 2.0 + k));
+
+	if (forgetting != 1.0) {
+		double s = sqrt(forgetting);
+		for (msize_t i=0; i<(msize_t)n * n; i++)
+			R.data[i] *= s;
+		for (msize_t i=0; i<(msize_t)n * k; i++)
+			QtB.data[i] *= s;
+		rss *= forgetting;
+	}
+
+	// zero w against the diagonal of R, one Givens rotation per column
+	for (mdim_t i=0; i<n; i++) {
+		if (w[i] == 0.0)
+			continue;
+		double* r = R.data + (msize_t)i * n;
+		double* d = QtB.data + (msize_t)i * k;
+		double h = hypot(r[i], w[i]);
+		double c = r[i] / h;
+		double s = w[i] / h;
+		r[i] = h;
+		for (mdim_t j=i+1; j<n; j++) {
+			double t = r[j];
+			r[j] = c * t + s * w[j];
+			w[j] = c * w[j] - s * t;
+		}
+		for (mdim_t l=0; l<k; l++) {
+			double t = d[l];
+			d[l] = c * t + s * e[l];
+			e[l] = c * e[l] - s * t;
+		}
+	}
+	// what is left of the targets is this row's share of the residual
+	for (mdim_t l=0; l<k; l++)
+		rss += e[l] * e[l];
+	count++;
+}
+
+bool IncrementalQR::addRows(const Matrix& A, const Matrix& B) {
+	mdim_t n = R.n, k = QtB.n;
+	if (A.n != n || B.n != k || A.m != B.m)
+		return false;
+	// gathered straight into the rotation buffer, addRow copies it onto itself
+	double* w = work.data;
+	for (mdim_t i=0; i<A.m; i++) {
+		for (mdim_t j=0; j<n; j++)
+			w[j] = A.get(i, j);
+		for (mdim_t l=0; l<k; l++)
+			w[n + l] = B.get(i, l);
+		addRow(w, w + n);
+	}
+	return true;
+}
+
+void IncrementalQR::reset() {
+	for (msize_t i=0; i<(msize_t)R.n * R.n; i++)
+		R.data[i] = 0.0;
+	for (msize_t i=0; i<(msize_t)QtB.m * QtB.n; i++)
+		QtB.data[i] = 0.0;
+	rss = 0.0;
+	count = 0;
+}
+
+bool IncrementalQR::solve_into(Matrix& out) const {
+	mdim_t n = R.n, k = QtB.n;
+	double biggest = 0.0;
+	for (mdim_t i=0; i<n; i++)
+		if (fabs(R.data[(msize_t)i * n + i]) > biggest)
+			biggest = fabs(R.data[(msize_t)i * n + i]);
+	double tolerance = biggest * n * 2.2e-16;
+	for (mdim_t i=0; i<n; i++)
+		if (!(fabs(R.data[(msize_t)i * n + i]) > tolerance))
+			return false;
+
+	if (out.m != n || out.n != k || out.isTransposed)
+		out = Matrix(n, k);
+	for (mdim_t l=0; l<k; l++)
+		for (mdim_t i=n; i-- > 0; ) {
+			const double* r = R.data + (msize_t)i * n;
+			double acc = QtB.data[(msize_t)i * k + l];
+			for (mdim_t j=i+1; j<n; j++)
+				acc -= r[j] * out.data[(msize_t)j * k + l];
+			out.data[(msize_t)i * k + l] = acc / r[i];
+		}
+	return true;
+}
+
+Matrix IncrementalQR::solve() const {
+	Matrix result;
+	if (!solve_into(result))
+		return Matrix(0, 0);
+	return result;
+}
+
+double IncrementalQR::residual() const {
+	return rss;
+}
+
+msize_t IncrementalQR::rows() const {
+	return count;
+}
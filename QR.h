@@ -0,0 +1,86 @@
+#ifndef QR_H_
+#define QR_H_
+
+#include "Matrix.h"
+
+// Reflectors per block: factor() updates the trailing columns, and solve()
+// applies Q^T, one block reflector I - Y T Y^T at a time, so the bulk of
+// the work is two matrix products (gemm for large problems).
+#ifndef MATRIX_QR_BLOCK
+#define MATRIX_QR_BLOCK 32
+#endif
+
+// Householder QR of a tall m x n matrix (m >= n), A = Q * R.
+// Least squares through QR works on A itself rather than on A^T * A, so
+// it does not square the condition number as the normal equations do.
+//
+//    QR qr(A);                     // samples x parameters
+//    if (qr.isFullRank())
+//        x = qr.solve(b);          // minimizes |A x - b| per column of b
+//
+// qr holds R on and above the diagonal and the Householder vectors (with
+// an implicit leading 1) below it; tau holds their scale factors.
+class QR {
+public:
+	QR();
+	QR(const Matrix& A);
+
+	// false for a wide or rank-deficient matrix
+	bool factor(const Matrix& A);
+	bool isFullRank() const;
+
+	// least-squares solution (n x k) for an m x k b, empty on failure
+	Matrix solve(const Matrix& b) const;
+	// b = Q^T * b in place (m x k), scratch from the current MatrixAllocator
+	Matrix& applyQt(Matrix& b) const;
+
+	Matrix R() const; // n x n upper triangular
+	Matrix Q() const; // m x n with orthonormal columns
+
+	Matrix qr;
+	Matrix tau;
+	bool ok;
+};
+
+// min |A x - b| for a tall A (m x n, m >= n) and b (m x k); an empty
+// matrix if A is wide or rank deficient
+Matrix lstsq(const Matrix& A, const Matrix& b);
+
+// Least squares fed one observation at a time. Keeps the triangular R and
+// Q^T b of everything seen so far and rotates each new row in with n Givens
+// rotations, O(n^2 + nk) per row and no refactoring, so a fit can run
+// continuously. A forgetting factor below 1 scales old rows by
+// sqrt(forgetting) per new row, letting the fit follow slow drift.
+//
+//    IncrementalQR fit(4, 3);        // 4 parameters, 3 outputs
+//    fit.addRow(sample, target);     // per sample
+//    Matrix X = fit.solve();         // 4 x 3
+class IncrementalQR {
+public:
+	IncrementalQR(mdim_t n, mdim_t k=1, double forgetting=1.0);
+
+	// a has n values, b has k
+	void addRow(const double* a, const double* b);
+	// every row of A (rows x n) with the matching row of B (rows x k)
+	bool addRows(const Matrix& A, const Matrix& B);
+	void reset();
+
+	// n x k, empty while the rows seen so far do not determine x
+	Matrix solve() const;
+	// same into out, allocating only if out is not n x k; false on failure
+	bool solve_into(Matrix& out) const;
+	// weighted sum of squared residuals of the current fit, over all outputs
+	double residual() const;
+	msize_t rows() const;
+
+	Matrix R;   // n x n upper triangular
+	Matrix QtB; // n x k
+	double forgetting;
+
+private:
+	Matrix work; // the incoming row, n + k values
+	double rss;
+	msize_t count;
+};
+
+#endif /* QR_H_ */
@@ -0,0 +1,277 @@
+#include "QuaternionBatch.h"
+#include "MatrixSimd.h"
+#include <stdint.h>
+
+// lanes are padded to this many elements and aligned to 32 bytes
+#define BATCH_PAD 4
+
+static msize_t padded(msize_t count) {
+	return (count + BATCH_PAD - 1) / BATCH_PAD * BATCH_PAD;
+}
+
+// allocates lanes * capacity zeroed doubles, returns the aligned start
+static double* allocateLanes(double*& storage, msize_t lanes, msize_t capacity) {
+	storage = new double[lanes * capacity + BATCH_PAD];
+	double* aligned = (double*)(((uintptr_t)storage + 31) & ~(uintptr_t)31);
+	for (msize_t i=0; i<lanes * capacity; i++)
+		aligned[i] = 0.0;
+	return aligned;
+}
+
+VectorBatch::VectorBatch(msize_t count) {
+	storage = 0;
+	capacity = 0;
+	this->count = 0;
+	x = y = z = 0;
+	resize(count);
+}
+
+VectorBatch::~VectorBatch() {
+	delete[] storage;
+}
+
+void VectorBatch::resize(msize_t count) {
+	if (padded(count) > capacity) {
+		delete[] storage;
+		capacity = padded(count);
+		x = allocateLanes(storage, 3, capacity);
+		y = x + capacity;
+		z = y + capacity;
+	}
+	this->count = count;
+}
+
+void VectorBatch::set(msize_t i, const Matrix& v) {
+	x[i] = v.get(0, 0);
+	y[i] = v.get(0, 1);
+	z[i] = v.get(0, 2);
+}
+
+Matrix VectorBatch::get(msize_t i) const {
+	Matrix result(1, 3);
+	result(0, 0) = x[i];
+	result(0, 1) = y[i];
+	result(0, 2) = z[i];
+	return result;
+}
+
+QuaternionBatch::QuaternionBatch(msize_t count) {
+	storage = 0;
+	capacity = 0;
+	this->count = 0;
+	w = x = y = z = 0;
+	resize(count);
+}
+
+QuaternionBatch::~QuaternionBatch() {
+	delete[] storage;
+}
+
+void QuaternionBatch::resize(msize_t count) {
+	if (padded(count) > capacity) {
+		delete[] storage;
+		capacity = padded(count);
+		w = allocateLanes(storage, 4, capacity);
+		x = w + capacity;
+		y = x + capacity;
+		z = y + capacity;
+	}
+	this->count = count;
+}
+
+void QuaternionBatch::set(msize_t i, const Matrix& q) {
+	w[i] = q.get(0, 0);
+	x[i] = q.get(0, 1);
+	y[i] = q.get(0, 2);
+	z[i] = q.get(0, 3);
+}
+
+Matrix QuaternionBatch::get(msize_t i) const {
+	Matrix result(1, 4);
+	result(0, 0) = w[i];
+	result(0, 1) = x[i];
+	result(0, 2) = y[i];
+	result(0, 3) = z[i];
+	return result;
+}
+
+// Kernels run over whole SIMD blocks; the padding lanes are computed too
+// and simply never read back.
+
+void QuaternionBatch::multiply(const QuaternionBatch& rhs, QuaternionBatch& out) const {
+	out.resize(count < rhs.count ? count : rhs.count);
+	msize_t end = padded(out.count);
+	for (msize_t i=0; i<end; i+=SIMD_WIDTH) {
+		simd_d aw = simd_load(w + i), ax = simd_load(x + i), ay = simd_load(y + i), az = simd_load(z + i);
+		simd_d bw = simd_load(rhs.w + i), bx = simd_load(rhs.x + i), by = simd_load(rhs.y + i), bz = simd_load(rhs.z + i);
+		simd_d rw = simd_sub(simd_sub(simd_sub(simd_mul(aw, bw), simd_mul(ax, bx)), simd_mul(ay, by)), simd_mul(az, bz));
+		simd_d rx = simd_sub(simd_add(simd_add(simd_mul(aw, bx), simd_mul(ax, bw)), simd_mul(ay, bz)), simd_mul(az, by));
+		simd_d ry = simd_add(simd_add(simd_sub(simd_mul(aw, by), simd_mul(ax, bz)), simd_mul(ay, bw)), simd_mul(az, bx));
+		simd_d rz = simd_add(simd_sub(simd_add(simd_mul(aw, bz), simd_mul(ax, by)), simd_mul(ay, bx)), simd_mul(az, bw));
+		simd_store(out.w + i, rw);
+		simd_store(out.x + i, rx);
+		simd_store(out.y + i, ry);
+		simd_store(out.z + i, rz);
+	}
+}
+
+void QuaternionBatch::inverse(QuaternionBatch& out) const {
+	out.resize(count);
+	msize_t end = padded(count);
+	simd_d one = simd_set1(1.0);
+	simd_d zero = simd_set1(0.0);
+	for (msize_t i=0; i<end; i+=SIMD_WIDTH) {
+		simd_d qw = simd_load(w + i), qx = simd_load(x + i), qy = simd_load(y + i), qz = simd_load(z + i);
+		simd_d sqr = simd_add(simd_add(simd_mul(qw, qw), simd_mul(qx, qx)), simd_add(simd_mul(qy, qy), simd_mul(qz, qz)));
+		simd_d inv = simd_div(one, sqr);
+		simd_store(out.w + i, simd_mul(qw, inv));
+		simd_store(out.x + i, simd_mul(simd_sub(zero, qx), inv));
+		simd_store(out.y + i, simd_mul(simd_sub(zero, qy), inv));
+		simd_store(out.z + i, simd_mul(simd_sub(zero, qz), inv));
+	}
+}
+
+void QuaternionBatch::conjugate(QuaternionBatch& out) const {
+	out.resize(count);
+	msize_t end = padded(count);
+	simd_d zero = simd_set1(0.0);
+	for (msize_t i=0; i<end; i+=SIMD_WIDTH) {
+		simd_store(out.w + i, simd_load(w + i));
+		simd_store(out.x + i, simd_sub(zero, simd_load(x + i)));
+		simd_store(out.y + i, simd_sub(zero, simd_load(y + i)));
+		simd_store(out.z + i, simd_sub(zero, simd_load(z + i)));
+	}
+}
+
+QuaternionBatch& QuaternionBatch::normalize() {
+	msize_t end = padded(count);
+	simd_d one = simd_set1(1.0);
+	// zero quaternions stay zero, like Matrix::normalize
+	simd_d tiny = simd_set1(1.0e-300);
+	for (msize_t i=0; i<end; i+=SIMD_WIDTH) {
+		simd_d qw = simd_load(w + i), qx = simd_load(x + i), qy = simd_load(y + i), qz = simd_load(z + i);
+		simd_d sqr = simd_add(simd_add(simd_mul(qw, qw), simd_mul(qx, qx)), simd_add(simd_mul(qy, qy), simd_mul(qz, qz)));
+		simd_d inv = simd_div(one, simd_max(simd_sqrt(sqr), tiny));
+		simd_store(w + i, simd_mul(qw, inv));
+		simd_store(x + i, simd_mul(qx, inv));
+		simd_store(y + i, simd_mul(qy, inv));
+		simd_store(z + i, simd_mul(qz, inv));
+	}
+	return *this;
+}
+
+// v' = ((w^2 - |q|^2) v + 2 (q.v) q + 2 w (q x v)) / (w^2 + |q|^2),
+// which is Q * v * Q^-1 without forming the two products; exact for
+// quaternions of any non-zero norm
+static inline void rotate_block(simd_d qw, simd_d qx, simd_d qy, simd_d qz,
+		simd_d vx, simd_d vy, simd_d vz, simd_d& rx, simd_d& ry, simd_d& rz) {
+	simd_d two = simd_set1(2.0);
+	simd_d ww = simd_mul(qw, qw);
+	simd_d qq = simd_add(simd_add(simd_mul(qx, qx), simd_mul(qy, qy)), simd_mul(qz, qz));
+	simd_d inv = simd_div(simd_set1(1.0), simd_add(ww, qq));
+	simd_d s = simd_sub(ww, qq);
+	simd_d d2 = simd_mul(two, simd_add(simd_add(simd_mul(qx, vx), simd_mul(qy, vy)), simd_mul(qz, vz)));
+	simd_d w2 = simd_mul(two, qw);
+	simd_d cx = simd_sub(simd_mul(qy, vz), simd_mul(qz, vy));
+	simd_d cy = simd_sub(simd_mul(qz, vx), simd_mul(qx, vz));
+	simd_d cz = simd_sub(simd_mul(qx, vy), simd_mul(qy, vx));
+	rx = simd_mul(simd_add(simd_add(simd_mul(s, vx), simd_mul(d2, qx)), simd_mul(w2, cx)), inv);
+	ry = simd_mul(simd_add(simd_add(simd_mul(s, vy), simd_mul(d2, qy)), simd_mul(w2, cy)), inv);
+	rz = simd_mul(simd_add(simd_add(simd_mul(s, vz), simd_mul(d2, qz)), simd_mul(w2, cz)), inv);
+}
+
+void QuaternionBatch::rotate(const VectorBatch& v, VectorBatch& out) const {
+	out.resize(v.count < count ? v.count : count);
+	msize_t end = padded(out.count);
+	for (msize_t i=0; i<end; i+=SIMD_WIDTH) {
+		simd_d rx, ry, rz;
+		rotate_block(simd_load(w + i), simd_load(x + i), simd_load(y + i), simd_load(z + i),
+				simd_load(v.x + i), simd_load(v.y + i), simd_load(v.z + i), rx, ry, rz);
+		simd_store(out.x + i, rx);
+		simd_store(out.y + i, ry);
+		simd_store(out.z + i, rz);
+	}
+}
+
+bool QuaternionBatch::rotate(const Matrix& Q, const VectorBatch& v, VectorBatch& out) {
+	if (Q.m != 1 || Q.n != 4)
+		return false;
+	out.resize(v.count);
+	msize_t end = padded(v.count);
+	simd_d qw = simd_set1(Q.get(0, 0)), qx = simd_set1(Q.get(0, 1)), qy = simd_set1(Q.get(0, 2)), qz = simd_set1(Q.get(0, 3));
+	for (msize_t i=0; i<end; i+=SIMD_WIDTH) {
+		simd_d rx, ry, rz;
+		rotate_block(qw, qx, qy, qz, simd_load(v.x + i), simd_load(v.y + i), simd_load(v.z + i), rx, ry, rz);
+		simd_store(out.x + i, rx);
+		simd_store(out.y + i, ry);
+		simd_store(out.z + i, rz);
+	}
+	return true;
+}
+
+static inline void cross_block(simd_d ux, simd_d uy, simd_d uz, simd_d vx, simd_d vy, simd_d vz,
+		simd_d& rx, simd_d& ry, simd_d& rz) {
+	rx = simd_sub(simd_mul(uy, vz), simd_mul(uz, vy));
+	ry = simd_sub(simd_mul(uz, vx), simd_mul(ux, vz));
+	rz = simd_sub(simd_mul(ux, vy), simd_mul(uy, vx));
+}
+
+static inline simd_d dot_block(simd_d ux, simd_d uy, simd_d uz, simd_d vx, simd_d vy, simd_d vz) {
+	return simd_add(simd_add(simd_mul(ux, vx), simd_mul(uy, vy)), simd_mul(uz, vz));
+}
+
+// scales to unit length times k; zero vectors stay zero, like Matrix::normalize
+static inline void normalize_block(simd_d& x, simd_d& y, simd_d& z, simd_d k) {
+	simd_d norm = simd_max(simd_sqrt(dot_block(x, y, z, x, y, z)), simd_set1(1.0e-300));
+	simd_d f = simd_div(k, norm);
+	x = simd_mul(x, f);
+	y = simd_mul(y, f);
+	z = simd_mul(z, f);
+}
+
+void QuaternionBatch::estimate(const VectorBatch& A, const VectorBatch& B,
+		const VectorBatch& A2, const VectorBatch& B2, QuaternionBatch& Q) {
+	msize_t count = A.count;
+	if (B.count < count) count = B.count;
+	if (A2.count < count) count = A2.count;
+	if (B2.count < count) count = B2.count;
+	Q.resize(count);
+	msize_t end = padded(count);
+	simd_d half = simd_set1(0.5);
+	simd_d one = simd_set1(1.0);
+
+	for (msize_t i=0; i<end; i+=SIMD_WIDTH) {
+		simd_d ax = simd_load(A.x + i), ay = simd_load(A.y + i), az = simd_load(A.z + i);
+		simd_d bx = simd_load(B.x + i), by = simd_load(B.y + i), bz = simd_load(B.z + i);
+		simd_d a2x = simd_load(A2.x + i), a2y = simd_load(A2.y + i), a2z = simd_load(A2.z + i);
+		simd_d b2x = simd_load(B2.x + i), b2y = simd_load(B2.y + i), b2z = simd_load(B2.z + i);
+
+		simd_d n1x, n1y, n1z, n2x, n2y, n2z, nx, ny, nz;
+		cross_block(ax, ay, az, bx, by, bz, n1x, n1y, n1z);
+		normalize_block(n1x, n1y, n1z, one);
+		cross_block(a2x, a2y, a2z, b2x, b2y, b2z, n2x, n2y, n2z);
+		normalize_block(n2x, n2y, n2z, one);
+
+		simd_d c = dot_block(n1x, n1y, n1z, n2x, n2y, n2z);
+		simd_d sin1 = simd_sqrt(simd_sub(half, simd_mul(half, c)));
+		simd_d cos1 = simd_sqrt(simd_add(half, simd_mul(half, c)));
+		cross_block(n1x, n1y, n1z, n2x, n2y, n2z, nx, ny, nz);
+		normalize_block(nx, ny, nz, sin1);
+
+		simd_d rx, ry, rz;
+		rotate_block(cos1, nx, ny, nz, ax, ay, az, rx, ry, rz);
+
+		c = dot_block(rx, ry, rz, a2x, a2y, a2z);
+		simd_d sin2 = simd_sqrt(simd_sub(half, simd_mul(half, c)));
+		simd_d cos2 = simd_sqrt(simd_add(half, simd_mul(half, c)));
+		simd_d px, py, pz;
+		cross_block(rx, ry, rz, a2x, a2y, a2z, px, py, pz);
+		normalize_block(px, py, pz, sin2);
+
+		// q2 * q1
+		simd_store(Q.w + i, simd_sub(simd_sub(simd_sub(simd_mul(cos2, cos1), simd_mul(px, nx)), simd_mul(py, ny)), simd_mul(pz, nz)));
+		simd_store(Q.x + i, simd_sub(simd_add(simd_add(simd_mul(cos2, nx), simd_mul(px, cos1)), simd_mul(py, nz)), simd_mul(pz, ny)));
+		simd_store(Q.y + i, simd_add(simd_add(simd_sub(simd_mul(cos2, ny), simd_mul(px, nz)), simd_mul(py, cos1)), simd_mul(pz, nx)));
+		simd_store(Q.z + i, simd_add(simd_sub(simd_add(simd_mul(cos2, nz), simd_mul(px, ny)), simd_mul(py, nx)), simd_mul(pz, cos1)));
+	}
+}
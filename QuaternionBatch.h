@@ -0,0 +1,75 @@
+#ifndef QUATERNIONBATCH_H_
+#define QUATERNIONBATCH_H_
+
+#include "Matrix.h"
+
+// Structure-of-arrays containers for many 3-vectors / quaternions.
+// Every component lives in its own 32-byte aligned lane, padded to a
+// multiple of 4, so the kernels process SIMD_WIDTH elements per step.
+// Results match Matrix::quaternion_multiply, quaternion_inverse and
+// quaternion_rotate element by element. Outputs may alias inputs.
+// Growing a batch past its capacity discards its contents.
+
+class VectorBatch {
+public:
+	VectorBatch(msize_t count=0);
+	~VectorBatch();
+	void resize(msize_t count);
+
+	// gather/scatter 1x3 row vectors
+	void set(msize_t i, const Matrix& v);
+	Matrix get(msize_t i) const;
+
+	double* x;
+	double* y;
+	double* z;
+	msize_t count;
+
+private:
+	VectorBatch(const VectorBatch&);
+	VectorBatch& operator=(const VectorBatch&);
+	double* storage;
+	msize_t capacity;
+};
+
+class QuaternionBatch {
+public:
+	QuaternionBatch(msize_t count=0);
+	~QuaternionBatch();
+	void resize(msize_t count);
+
+	// gather/scatter 1x4 (w, x, y, z) row vectors
+	void set(msize_t i, const Matrix& q);
+	Matrix get(msize_t i) const;
+
+	// out[i] = this[i] * rhs[i] (Hamilton product)
+	void multiply(const QuaternionBatch& rhs, QuaternionBatch& out) const;
+	void inverse(QuaternionBatch& out) const;
+	void conjugate(QuaternionBatch& out) const;
+	QuaternionBatch& normalize();
+
+	// out[i] = this[i] * v[i] * this[i]^-1
+	void rotate(const VectorBatch& v, VectorBatch& out) const;
+	// out[i] = Q * v[i] * Q^-1 for a single 1x4 quaternion Q; false, with
+	// out untouched, for any other shape
+	static bool rotate(const Matrix& Q, const VectorBatch& v, VectorBatch& out);
+
+	// Q[i] = Matrix::estimate_quaternion_into(A[i], B[i], A2[i], B2[i]) for
+	// every vector-pair set, SIMD_WIDTH sets per step
+	static void estimate(const VectorBatch& A, const VectorBatch& B,
+			const VectorBatch& A2, const VectorBatch& B2, QuaternionBatch& Q);
+
+	double* w;
+	double* x;
+	double* y;
+	double* z;
+	msize_t count;
+
+private:
+	QuaternionBatch(const QuaternionBatch&);
+	QuaternionBatch& operator=(const QuaternionBatch&);
+	double* storage;
+	msize_t capacity;
+};
+
+#endif /* QUATERNIONBATCH_H_ */
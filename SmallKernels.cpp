@@ -0,0 +1,166 @@
+#include "SmallKernels.h"
+#include <math.h>
+#include <stddef.h>
+
+#if MATRIX_SMALL_KERNELS
+
+// r = a * b for row-major N x N a and b, written out because neither -O2
+// nor -Os unrolls the nested loops; the sums run in the same order as the
+// generic loop
+static inline void mul2(const double* a, const double* b, double* r) {
+	r[0] = a[0] * b[0] + a[1] * b[2];
+	r[1] = a[0] * b[1] + a[1] * b[3];
+	r[2] = a[2] * b[0] + a[3] * b[2];
+	r[3] = a[2] * b[1] + a[3] * b[3];
+}
+
+static inline void mul3(const double* a, const double* b, double* r) {
+	r[0] = a[0] * b[0] + a[1] * b[3] + a[2] * b[6];
+	r[1] = a[0] * b[1] + a[1] * b[4] + a[2] * b[7];
+	r[2] = a[0] * b[2] + a[1] * b[5] + a[2] * b[8];
+	r[3] = a[3] * b[0] + a[4] * b[3] + a[5] * b[6];
+	r[4] = a[3] * b[1] + a[4] * b[4] + a[5] * b[7];
+	r[5] = a[3] * b[2] + a[4] * b[5] + a[5] * b[8];
+	r[6] = a[6] * b[0] + a[7] * b[3] + a[8] * b[6];
+	r[7] = a[6] * b[1] + a[7] * b[4] + a[8] * b[7];
+	r[8] = a[6] * b[2] + a[7] * b[5] + a[8] * b[8];
+}
+
+static inline void mul4(const double* a, const double* b, double* r) {
+	r[0] = a[0] * b[0] + a[1] * b[4] + a[2] * b[8] + a[3] * b[12];
+	r[1] = a[0] * b[1] + a[1] * b[5] + a[2] * b[9] + a[3] * b[13];
+	r[2] = a[0] * b[2] + a[1] * b[6] + a[2] * b[10] + a[3] * b[14];
+	r[3] = a[0] * b[3] + a[1] * b[7] + a[2] * b[11] + a[3] * b[15];
+	r[4] = a[4] * b[0] + a[5] * b[4] + a[6] * b[8] + a[7] * b[12];
+	r[5] = a[4] * b[1] + a[5] * b[5] + a[6] * b[9] + a[7] * b[13];
+	r[6] = a[4] * b[2] + a[5] * b[6] + a[6] * b[10] + a[7] * b[14];
+	r[7] = a[4] * b[3] + a[5] * b[7] + a[6] * b[11] + a[7] * b[15];
+	r[8] = a[8] * b[0] + a[9] * b[4] + a[10] * b[8] + a[11] * b[12];
+	r[9] = a[8] * b[1] + a[9] * b[5] + a[10] * b[9] + a[11] * b[13];
+	r[10] = a[8] * b[2] + a[9] * b[6] + a[10] * b[10] + a[11] * b[14];
+	r[11] = a[8] * b[3] + a[9] * b[7] + a[10] * b[11] + a[11] * b[15];
+	r[12] = a[12] * b[0] + a[13] * b[4] + a[14] * b[8] + a[15] * b[12];
+	r[13] = a[12] * b[1] + a[13] * b[5] + a[14] * b[9] + a[15] * b[13];
+	r[14] = a[12] * b[2] + a[13] * b[6] + a[14] * b[10] + a[15] * b[14];
+	r[15] = a[12] * b[3] + a[13] * b[7] + a[14] * b[11] + a[15] * b[15];
+}
+
+// r = a * v for a row-major N x N a and an N-vector v
+static inline void mv2(const double* a, const double* v, double* r) {
+	r[0] = a[0] * v[0] + a[1] * v[1];
+	r[1] = a[2] * v[0] + a[3] * v[1];
+}
+
+static inline void mv3(const double* a, const double* v, double* r) {
+	r[0] = a[0] * v[0] + a[1] * v[1] + a[2] * v[2];
+	r[1] = a[3] * v[0] + a[4] * v[1] + a[5] * v[2];
+	r[2] = a[6] * v[0] + a[7] * v[1] + a[8] * v[2];
+}
+
+static inline void mv4(const double* a, const double* v, double* r) {
+	r[0] = a[0] * v[0] + a[1] * v[1] + a[2] * v[2] + a[3] * v[3];
+	r[1] = a[4] * v[0] + a[5] * v[1] + a[6] * v[2] + a[7] * v[3];
+	r[2] = a[8] * v[0] + a[9] * v[1] + a[10] * v[2] + a[11] * v[3];
+	r[3] = a[12] * v[0] + a[13] * v[1] + a[14] * v[2] + a[15] * v[3];
+}
+
+// the rows x cols operand at a in row-major order: a itself when it already
+// is (a vector always is, up to its stride), otherwise a copy in buf
+static inline const double* rowMajor(const double* a, int rs, int cs, int rows, int cols, double* buf) {
+	if (rows == 1 || cols == 1) {
+		int stride = rows == 1 ? cs : rs;
+		if (stride == 1)
+			return a;
+		for (int i=0; i<rows * cols; i++)
+			buf[i] = a[(ptrdiff_t)i * stride];
+		return buf;
+	}
+	if (cs == 1 && rs == cols)
+		return a;
+	for (int i=0; i<rows; i++)
+		for (int j=0; j<cols; j++)
+			buf[i * cols + j] = a[(ptrdiff_t)i * rs + (ptrdiff_t)j * cs];
+	return buf;
+}
+
+// N is a template parameter so each size is its own straight-line code
+template<int N>
+static bool gemm_n(unsigned int m, unsigned int n, double alpha,
+		const double* a, int rsa, int csa, const double* b, int rsb, int csb,
+		double beta, double* c, int rsc, int csc) {
+	double abuf[N * N], bbuf[N * N], r[N * N];
+	if (m == N && n == N) {
+		const double* a_ = rowMajor(a, rsa, csa, N, N, abuf);
+		const double* b_ = rowMajor(b, rsb, csb, N, N, bbuf);
+		if (N == 2) mul2(a_, b_, r);
+		else if (N == 3) mul3(a_, b_, r);
+		else mul4(a_, b_, r);
+	} else if ((m == N && n == 1) || (m == 1 && n == N)) {
+		// a row vector times B is B^T times the vector: B read with its strides swapped
+		const double* mat = m == 1 ? rowMajor(b, csb, rsb, N, N, bbuf) : rowMajor(a, rsa, csa, N, N, abuf);
+		const double* vec = m == 1 ? rowMajor(a, rsa, csa, 1, N, abuf) : rowMajor(b, rsb, csb, N, 1, bbuf);
+		if (N == 2) mv2(mat, vec, r);
+		else if (N == 3) mv3(mat, vec, r);
+		else mv4(mat, vec, r);
+	} else
+		return false;
+
+	// A and B have been read in full, so C may be either of them
+	if (beta == 0.0 && alpha == 1.0 && csc == 1 && (rsc == (int)n || m == 1)) {
+		for (unsigned int t=0; t<m * n; t++)
+			c[t] = r[t];
+		return true;
+	}
+	for (unsigned int i=0; i<m; i++)
+		for (unsigned int j=0; j<n; j++) {
+			double* cij = c + (ptrdiff_t)i * rsc + (ptrdiff_t)j * csc;
+			*cij = beta == 0.0 ? alpha * r[i * n + j] : alpha * r[i * n + j] + beta * *cij;
+		}
+	return true;
+}
+
+bool small_gemm(unsigned int m, unsigned int n, unsigned int k, double alpha,
+		const double* a, int rsa, int csa, const double* b, int rsb, int csb,
+		double beta, double* c, int rsc, int csc) {
+	switch (k) {
+	case 2: return gemm_n<2>(m, n, alpha, a, rsa, csa, b, rsb, csb, beta, c, rsc, csc);
+	case 3: return gemm_n<3>(m, n, alpha, a, rsa, csa, b, rsb, csb, beta, c, rsc, csc);
+	case 4: return gemm_n<4>(m, n, alpha, a, rsa, csa, b, rsb, csb, beta, c, rsc, csc);
+	default: return false;
+	}
+}
+
+// a determinant that overflowed, underflowed to zero or whose reciprocal
+// overflows says nothing about the matrix itself, so only a finite,
+// nonzero det with a finite 1 / det is used
+template<class F>
+static inline bool inverse_with(const F& f, double* out) {
+	double inv = 1.0 / f.det;
+	if (f.det == 0.0 || !isfinite(f.det) || !isfinite(inv))
+		return false;
+	f.write(inv, out);
+	return true;
+}
+
+bool small_inverse(unsigned int n, const double* a, double* out) {
+	switch (n) {
+	case 2: return inverse_with(Cofactors2<double>(a), out);
+	case 3: return inverse_with(Cofactors3<double>(a), out);
+	case 4: return inverse_with(Cofactors4<double>(a), out);
+	default: return false;
+	}
+}
+
+#else
+
+bool small_gemm(unsigned int, unsigned int, unsigned int, double,
+		const double*, int, int, const double*, int, int,
+		double, double*, int, int) {
+	return false;
+}
+
+bool small_inverse(unsigned int, const double*, double*) {
+	return false;
+}
+
+#endif
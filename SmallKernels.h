@@ -0,0 +1,122 @@
+#ifndef SMALLKERNELS_H_
+#define SMALLKERNELS_H_
+
+// Closed-form kernels for the 2x2, 3x3 and 4x4 products and inverses that
+// attitude and filter code is made of. Matrix::dot_into, dotSelf and
+// inverse dispatch to them by shape. The arithmetic is written out in
+// full; a lazily transposed operand is first copied to row-major locals.
+// Define MATRIX_SMALL_KERNELS 0 to leave them out where flash is tighter
+// than time.
+#ifndef MATRIX_SMALL_KERNELS
+#define MATRIX_SMALL_KERNELS 1
+#endif
+
+// C (m x n) = alpha * A (m x k) * B (k x n) + beta * C for N x N times
+// N x N, N x N times N x 1 and 1 x N times N x N with N = 2, 3 or 4.
+// Element (i, j) of X is at x[i * rsx + j * csx]. C is only written after
+// A and B have been read, so it may be one of them. Returns false, without
+// touching C, for any other shape; C is not read when beta is 0.
+bool small_gemm(unsigned int m, unsigned int n, unsigned int k, double alpha,
+		const double* a, int rsa, int csa, const double* b, int rsb, int csb,
+		double beta, double* c, int rsc, int csc);
+
+// out = a^-1 for a contiguous n x n (n = 2, 3 or 4) matrix by cofactors;
+// out may be a. Returns false, leaving out untouched, when the determinant
+// or its reciprocal is not a finite nonzero number: singular, or just
+// scaled beyond what the closed form can represent, so callers fall back to
+// pivoting. Either storage order works, as (A^T)^-1 is (A^-1)^T.
+bool small_inverse(unsigned int n, const double* a, double* out);
+
+// Cofactor inverse of a row-major 2x2, 3x3 or 4x4 matrix in two steps:
+// the constructor reads a and finds det, then write(inv, out) stores
+// a^-1 given inv = 1 / det, so scalar code can stop at a zero determinant
+// before dividing. out may be a. Templated on the element so MatrixBatch
+// runs the same formulas on a SIMD vector of matrices (V needs +, - and *).
+template<class V>
+struct Cofactors2 {
+	V a00, a01, a10, a11, det;
+	Cofactors2(const V* a) : a00(a[0]), a01(a[1]), a10(a[2]), a11(a[3]) {
+		det = a00 * a11 - a01 * a10;
+	}
+	void write(V inv, V* out) const {
+		out[0] = a11 * inv;
+		out[1] = -a01 * inv;
+		out[2] = -a10 * inv;
+		out[3] = a00 * inv;
+	}
+};
+
+template<class V>
+struct Cofactors3 {
+	V a00, a01, a02, a10, a11, a12, a20, a21, a22;
+	V c00, c10, c20, det; // cofactors of the first column
+	Cofactors3(const V* a) : a00(a[0]), a01(a[1]), a02(a[2]), a10(a[3]), a11(a[4]), a12(a[5]),
+			a20(a[6]), a21(a[7]), a22(a[8]) {
+		c00 = a11 * a22 - a12 * a21;
+		c10 = a12 * a20 - a10 * a22;
+		c20 = a10 * a21 - a11 * a20;
+		det = a00 * c00 + a01 * c10 + a02 * c20;
+	}
+	void write(V inv, V* out) const {
+		out[0] = c00 * inv;
+		out[1] = (a02 * a21 - a01 * a22) * inv;
+		out[2] = (a01 * a12 - a02 * a11) * inv;
+		out[3] = c10 * inv;
+		out[4] = (a00 * a22 - a02 * a20) * inv;
+		out[5] = (a02 * a10 - a00 * a12) * inv;
+		out[6] = c20 * inv;
+		out[7] = (a01 * a20 - a00 * a21) * inv;
+		out[8] = (a00 * a11 - a01 * a10) * inv;
+	}
+};
+
+// Laplace expansion along the top two rows: the six 2x2 minors of rows 0-1
+// (s) and of rows 2-3 (c) give the determinant and every cofactor
+template<class V>
+struct Cofactors4 {
+	V a00, a01, a02, a03, a10, a11, a12, a13, a20, a21, a22, a23, a30, a31, a32, a33;
+	V s0, s1, s2, s3, s4, s5, c0, c1, c2, c3, c4, c5, det;
+	Cofactors4(const V* a) : a00(a[0]), a01(a[1]), a02(a[2]), a03(a[3]),
+			a10(a[4]), a11(a[5]), a12(a[6]), a13(a[7]),
+			a20(a[8]), a21(a[9]), a22(a[10]), a23(a[11]),
+			a30(a[12]), a31(a[13]), a32(a[14]), a33(a[15]) {
+		s0 = a00 * a11 - a10 * a01;
+		s1 = a00 * a12 - a10 * a02;
+		s2 = a00 * a13 - a10 * a03;
+		s3 = a01 * a12 - a11 * a02;
+		s4 = a01 * a13 - a11 * a03;
+		s5 = a02 * a13 - a12 * a03;
+
+		c5 = a22 * a33 - a32 * a23;
+		c4 = a21 * a33 - a31 * a23;
+		c3 = a21 * a32 - a31 * a22;
+		c2 = a20 * a33 - a30 * a23;
+		c1 = a20 * a32 - a30 * a22;
+		c0 = a20 * a31 - a30 * a21;
+
+		det = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+	}
+	void write(V inv, V* out) const {
+		out[0] = (a11 * c5 - a12 * c4 + a13 * c3) * inv;
+		out[1] = (a02 * c4 - a01 * c5 - a03 * c3) * inv;
+		out[2] = (a31 * s5 - a32 * s4 + a33 * s3) * inv;
+		out[3] = (a22 * s4 - a21 * s5 - a23 * s3) * inv;
+
+		out[4] = (a12 * c2 - a10 * c5 - a13 * c1) * inv;
+		out[5] = (a00 * c5 - a02 * c2 + a03 * c1) * inv;
+		out[6] = (a32 * s2 - a30 * s5 - a33 * s1) * inv;
+		out[7] = (a20 * s5 - a22 * s2 + a23 * s1) * inv;
+
+		out[8] = (a10 * c4 - a11 * c2 + a13 * c0) * inv;
+		out[9] = (a01 * c2 - a00 * c4 - a03 * c0) * inv;
+		out[10] = (a30 * s4 - a31 * s2 + a33 * s0) * inv;
+		out[11] = (a21 * s2 - a20 * s4 - a23 * s0) * inv;
+
+		out[12] = (a11 * c1 - a10 * c3 - a12 * c0) * inv;
+		out[13] = (a00 * c3 - a01 * c1 + a02 * c0) * inv;
+		out[14] = (a31 * s1 - a30 * s3 - a32 * s0) * inv;
+		out[15] = (a20 * s3 - a21 * s1 + a22 * s0) * inv;
+	}
+};
+
+#endif /* SMALLKERNELS_H_ */
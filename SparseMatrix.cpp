@@ -0,0 +1,212 @@
+#include "SparseMatrix.h"
+#include "MatrixStats.h"
+#include <math.h>
+
+SparseMatrix::SparseMatrix() {
+	m = 0;
+	n = 0;
+	rowStart = 0;
+	columns = 0;
+	values = 0;
+}
+
+SparseMatrix::SparseMatrix(const Matrix& dense, double tolerance) {
+	rowStart = 0;
+	msize_t count = 0;
+	for (mdim_t i=0; i<dense.m; i++)
+		for (mdim_t j=0; j<dense.n; j++)
+			if (fabs(dense.get(i, j)) > tolerance)
+				count++;
+	allocate(dense.m, dense.n, count);
+
+	count = 0;
+	for (mdim_t i=0; i<m; i++) {
+		rowStart[i] = count;
+		for (mdim_t j=0; j<n; j++) {
+			double v = dense.get(i, j);
+			if (fabs(v) > tolerance) {
+				columns[count] = j;
+				values[count] = v;
+				count++;
+			}
+		}
+	}
+	rowStart[m] = count;
+}
+
+SparseMatrix::SparseMatrix(mdim_t m, mdim_t n, const msize_t* rowStart, const mdim_t* columns, const double* values) {
+	this->rowStart = 0;
+	allocate(m, n, rowStart[m]);
+	for (msize_t i=0; i<=(msize_t)m; i++)
+		this->rowStart[i] = rowStart[i];
+	for (msize_t k=0; k<rowStart[m]; k++) {
+		this->columns[k] = columns[k];
+		this->values[k] = values[k];
+	}
+}
+
+SparseMatrix::SparseMatrix(const SparseMatrix& rhs) {
+	this->rowStart = 0;
+	*this = rhs;
+}
+
+SparseMatrix::SparseMatrix(SparseMatrix&& rhs) {
+	this->rowStart = 0;
+	*this = static_cast<SparseMatrix&&>(rhs);
+}
+
+SparseMatrix::~SparseMatrix() {
+	release();
+}
+
+SparseMatrix& SparseMatrix::operator=(const SparseMatrix& rhs) {
+	if (this != &rhs) {
+		release();
+		// a default-constructed or moved-from rhs has no arrays at all
+		if (!rhs.rowStart)
+			return *this;
+		allocate(rhs.m, rhs.n, rhs.nonZeros());
+		for (msize_t i=0; i<=(msize_t)m; i++)
+			rowStart[i] = rhs.rowStart[i];
+		for (msize_t k=0; k<rhs.nonZeros(); k++) {
+			columns[k] = rhs.columns[k];
+			values[k] = rhs.values[k];
+		}
+	}
+	return *this;
+}
+
+SparseMatrix& SparseMatrix::operator=(SparseMatrix&& rhs) {
+	if (this != &rhs) {
+		release();
+		m = rhs.m;
+		n = rhs.n;
+		rowStart = rhs.rowStart;
+		columns = rhs.columns;
+		values = rhs.values;
+		rhs.m = 0;
+		rhs.n = 0;
+		rhs.rowStart = 0;
+		rhs.columns = 0;
+		rhs.values = 0;
+	}
+	return *this;
+}
+
+void SparseMatrix::allocate(mdim_t m, mdim_t n, msize_t nonZeros) {
+	release();
+	this->m = m;
+	this->n = n;
+	rowStart = new msize_t[(msize_t)m + 1];
+	columns = nonZeros ? new mdim_t[nonZeros] : 0;
+	values = nonZeros ? new double[nonZeros] : 0;
+	rowStart[0] = 0;
+}
+
+void SparseMatrix::release() {
+	if (rowStart) {
+		delete[] rowStart;
+		delete[] columns;
+		delete[] values;
+	}
+	m = 0;
+	n = 0;
+	rowStart = 0;
+	columns = 0;
+	values = 0;
+}
+
+msize_t SparseMatrix::nonZeros() const {
+	return rowStart ? rowStart[m] : 0;
+}
+
+double SparseMatrix::get(mdim_t i, mdim_t j) const {
+	// columns are sorted within a row
+	msize_t lo = rowStart[i], hi = rowStart[i + 1];
+	while (lo < hi) {
+		msize_t mid = lo + (hi - lo) / 2;
+		if (columns[mid] < j)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo < rowStart[i + 1] && columns[lo] == j ? values[lo] : 0.0;
+}
+
+Matrix SparseMatrix::toMatrix() const {
+	Matrix result(m, n);
+	for (mdim_t i=0; i<m; i++)
+		for (msize_t k=rowStart[i]; k<rowStart[i + 1]; k++)
+			result(i, columns[k]) = values[k];
+	return result;
+}
+
+SparseMatrix SparseMatrix::transposed() const {
+	SparseMatrix result;
+	result.allocate(n, m, nonZeros());
+
+	// count per column, prefix-sum into row starts of the transpose
+	for (msize_t j=0; j<=(msize_t)n; j++)
+		result.rowStart[j] = 0;
+	for (msize_t k=0; k<nonZeros(); k++)
+		result.rowStart[columns[k] + 1]++;
+	for (msize_t j=0; j<n; j++)
+		result.rowStart[j + 1] += result.rowStart[j];
+
+	// rows are visited in order, so each transposed row stays sorted;
+	// rowStart[j] serves as the fill cursor and ends up one row ahead
+	for (mdim_t i=0; i<m; i++)
+		for (msize_t k=rowStart[i]; k<rowStart[i + 1]; k++) {
+			msize_t dst = result.rowStart[columns[k]]++;
+			result.columns[dst] = i;
+			result.values[dst] = values[k];
+		}
+	for (msize_t j=n; j>0; j--)
+		result.rowStart[j] = result.rowStart[j - 1];
+	result.rowStart[0] = 0;
+	return result;
+}
+
+Matrix SparseMatrix::dot(const Matrix& dense, bool left) const {
+	if (left) {
+		// dense (q x m) * this (m x n): scatter each dense entry along row i
+		if (dense.n != m)
+			return Matrix(0, 0);
+		MATRIX_STATS_OP(MATRIX_OP_DOT, 2.0 * nonZeros() * dense.m);
+		Matrix result(dense.m, n);
+		for (mdim_t r=0; r<dense.m; r++) {
+			double* out = result.data + (msize_t)r * n;
+			for (mdim_t i=0; i<m; i++) {
+				double d = dense.get(r, i);
+				if (d == 0.0)
+					continue;
+				for (msize_t k=rowStart[i]; k<rowStart[i + 1]; k++)
+					out[columns[k]] += d * values[k];
+			}
+		}
+		return result;
+	}
+
+	// this (m x n) * dense (n x p): row i is a combination of dense rows
+	if (n != dense.m)
+		return Matrix(0, 0);
+	MATRIX_STATS_OP(MATRIX_OP_DOT, 2.0 * nonZeros() * dense.n);
+	Matrix result(m, dense.n);
+	mdim_t p = dense.n;
+	for (mdim_t i=0; i<m; i++) {
+		double* out = result.data + (msize_t)i * p;
+		for (msize_t k=rowStart[i]; k<rowStart[i + 1]; k++) {
+			double v = values[k];
+			mdim_t j = columns[k];
+			if (dense.isTransposed) {
+				for (mdim_t c=0; c<p; c++)
+					out[c] += v * dense.get(j, c);
+			} else {
+				const double* in = dense.data + (msize_t)j * p;
+				for (mdim_t c=0; c<p; c++)
+					out[c] += v * in[c];
+			}
+		}
+	}
+	return result;
+}
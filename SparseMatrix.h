@@ -0,0 +1,48 @@
+#ifndef SPARSEMATRIX_H_
+#define SPARSEMATRIX_H_
+
+#include "Matrix.h"
+
+// Compressed sparse row matrix: only non-zeros are stored, row by row.
+// The non-zeros of row i are values[rowStart[i] .. rowStart[i+1]-1] in
+// columns columns[...], ascending. Products against a dense Matrix skip
+// every zero, so they cost 2 * nonZeros() * (other dimension) flops.
+//
+//    SparseMatrix J(jacobian);          // drops exact zeros
+//    Matrix y = J.dot(x);               // J * x
+//    Matrix z = x.dot(J, true);         // J * x as well, Matrix::dot semantics
+class SparseMatrix {
+public:
+	SparseMatrix();
+	// keeps entries with |a(i, j)| > tolerance
+	SparseMatrix(const Matrix& dense, double tolerance=0.0);
+	// copies CSR arrays (rowStart has m + 1 entries, rowStart[m] non-zeros)
+	SparseMatrix(mdim_t m, mdim_t n, const msize_t* rowStart, const mdim_t* columns, const double* values);
+	SparseMatrix(const SparseMatrix& rhs);
+	SparseMatrix(SparseMatrix&& rhs);
+	~SparseMatrix();
+	SparseMatrix& operator=(const SparseMatrix& rhs);
+	SparseMatrix& operator=(SparseMatrix&& rhs);
+
+	msize_t nonZeros() const;
+	double get(mdim_t i, mdim_t j) const;
+	Matrix toMatrix() const;
+	// CSR of the transpose, built with a counting sort over the columns
+	SparseMatrix transposed() const;
+
+	// left: dense * this, otherwise this * dense (same as Matrix::dot);
+	// an empty matrix on shape mismatch
+	Matrix dot(const Matrix& dense, bool left=false) const;
+
+	mdim_t m;
+	mdim_t n;
+	msize_t* rowStart;
+	mdim_t* columns;
+	double* values;
+
+private:
+	void allocate(mdim_t m, mdim_t n, msize_t nonZeros);
+	void release();
+};
+
+#endif /* SPARSEMATRIX_H_ */
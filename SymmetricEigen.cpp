@@ -0,0 +1,95 @@
+#include "SymmetricEigen.h"
+#include <math.h>
+
+SymmetricEigen::SymmetricEigen() {
+	ok = false;
+}
+
+SymmetricEigen::SymmetricEigen(const Matrix& A) {
+	ok = false;
+	compute(A);
+}
+
+bool SymmetricEigen::compute(const Matrix& A, unsigned int maxSweeps) {
+	ok = false;
+	if (A.m != A.n)
+		return false;
+	mdim_t n = A.n;
+
+	Matrix a(n, n);
+	for (mdim_t i=0; i<n; i++)
+		for (mdim_t j=0; j<=i; j++)
+			a(i, j) = a(j, i) = A.get(i, j);
+	vectors = Matrix::identity(n);
+
+	double total = 0.0;
+	for (mdim_t i=0; i<n; i++)
+		for (mdim_t j=0; j<n; j++)
+			total += a(i, j) * a(i, j);
+
+	for (unsigned int sweep=0; sweep<maxSweeps && !ok; sweep++) {
+		double off = 0.0;
+		for (mdim_t i=0; i<n; i++)
+			for (mdim_t j=i+1; j<n; j++)
+				off += a(i, j) * a(i, j);
+		if (off <= 1.0e-30 * total) {
+			ok = true;
+			break;
+		}
+
+		for (mdim_t p=0; p<n; p++)
+			for (mdim_t q=p+1; q<n; q++) {
+				double apq = a(p, q);
+				if (apq == 0.0)
+					continue;
+				// rotation angle that zeroes a(p, q)
+				double theta = (a(q, q) - a(p, p)) / (2.0 * apq);
+				double t = (theta >= 0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+				double c = 1.0 / sqrt(t * t + 1.0);
+				double s = t * c;
+
+				for (mdim_t k=0; k<n; k++) {
+					double akp = a(k, p);
+					double akq = a(k, q);
+					a(k, p) = c * akp - s * akq;
+					a(k, q) = s * akp + c * akq;
+				}
+				for (mdim_t k=0; k<n; k++) {
+					double apk = a(p, k);
+					double aqk = a(q, k);
+					a(p, k) = c * apk - s * aqk;
+					a(q, k) = s * apk + c * aqk;
+				}
+				for (mdim_t k=0; k<n; k++) {
+					double vkp = vectors(k, p);
+					double vkq = vectors(k, q);
+					vectors(k, p) = c * vkp - s * vkq;
+					vectors(k, q) = s * vkp + c * vkq;
+				}
+			}
+	}
+	if (!ok)
+		return false;
+
+	// selection sort by descending eigenvalue, swapping vector columns along
+	values = Matrix(n, 1);
+	for (mdim_t i=0; i<n; i++)
+		values(i) = a(i, i);
+	for (mdim_t i=0; i<n; i++) {
+		mdim_t best = i;
+		for (mdim_t j=i+1; j<n; j++)
+			if (values(j) > values(best))
+				best = j;
+		if (best != i) {
+			double tmp = values(i);
+			values(i) = values(best);
+			values(best) = tmp;
+			for (mdim_t k=0; k<n; k++) {
+				tmp = vectors(k, i);
+				vectors(k, i) = vectors(k, best);
+				vectors(k, best) = tmp;
+			}
+		}
+	}
+	return true;
+}
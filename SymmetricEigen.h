@@ -0,0 +1,23 @@
+#ifndef SYMMETRICEIGEN_H_
+#define SYMMETRICEIGEN_H_
+
+#include "Matrix.h"
+
+// Eigen-decomposition A = V * diag(values) * V^T of a symmetric matrix
+// by cyclic Jacobi rotations. Simple and accurate for the small matrices
+// used here (the 4x4 Davenport K matrix, covariances). Only the lower
+// triangle of A is read.
+class SymmetricEigen {
+public:
+	SymmetricEigen();
+	SymmetricEigen(const Matrix& A);
+
+	// returns false for non-square input or if the sweeps did not converge
+	bool compute(const Matrix& A, unsigned int maxSweeps=50);
+
+	Matrix values;  // n x 1, sorted descending
+	Matrix vectors; // n x n, column i goes with values(i)
+	bool ok;
+};
+
+#endif /* SYMMETRICEIGEN_H_ */
@@ -0,0 +1,220 @@
+#include "SymmetricMatrix.h"
+#include "MatrixAllocator.h"
+#include "MatrixStats.h"
+#include "MatrixSimd.h"
+#include <stddef.h>
+
+static inline msize_t packed(mdim_t i, mdim_t j) {
+	return i >= j ? (msize_t)i * (i + 1) / 2 + j : (msize_t)j * (j + 1) / 2 + i;
+}
+
+SymmetricMatrix::SymmetricMatrix(mdim_t n) {
+	data = 0;
+	allocate(n);
+	for (msize_t k=0; k<size(); k++)
+		data[k] = 0.0;
+}
+
+SymmetricMatrix::SymmetricMatrix(const Matrix& A) {
+	data = 0;
+	allocate(A.m == A.n ? A.n : 0);
+	for (mdim_t i=0; i<n; i++)
+		for (mdim_t j=0; j<=i; j++)
+			data[packed(i, j)] = A.get(i, j);
+}
+
+SymmetricMatrix::SymmetricMatrix(const SymmetricMatrix& rhs) {
+	data = 0;
+	n = 0;
+	*this = rhs;
+}
+
+SymmetricMatrix::SymmetricMatrix(SymmetricMatrix&& rhs) {
+	data = rhs.data;
+	n = rhs.n;
+	rhs.data = 0;
+	rhs.n = 0;
+}
+
+SymmetricMatrix::~SymmetricMatrix() {
+	delete[] data;
+}
+
+SymmetricMatrix& SymmetricMatrix::operator=(const SymmetricMatrix& rhs) {
+	if (this != &rhs) {
+		if (n != rhs.n)
+			allocate(rhs.n);
+		for (msize_t k=0; k<size(); k++)
+			data[k] = rhs.data[k];
+	}
+	return *this;
+}
+
+SymmetricMatrix& SymmetricMatrix::operator=(SymmetricMatrix&& rhs) {
+	if (this != &rhs) {
+		delete[] data;
+		data = rhs.data;
+		n = rhs.n;
+		rhs.data = 0;
+		rhs.n = 0;
+	}
+	return *this;
+}
+
+void SymmetricMatrix::allocate(mdim_t n) {
+	delete[] data;
+	this->n = n;
+	data = n ? new double[size()] : 0;
+}
+
+double& SymmetricMatrix::operator()(mdim_t i, mdim_t j) {
+	return data[packed(i, j)];
+}
+
+double SymmetricMatrix::get(mdim_t i, mdim_t j) const {
+	return data[packed(i, j)];
+}
+
+msize_t SymmetricMatrix::size() const {
+	return (msize_t)n * (n + 1) / 2;
+}
+
+Matrix SymmetricMatrix::toMatrix() const {
+	Matrix result(n, n);
+	for (mdim_t i=0; i<n; i++)
+		for (mdim_t j=0; j<=i; j++)
+			result(i, j) = result(j, i) = data[packed(i, j)];
+	return result;
+}
+
+SymmetricMatrix& SymmetricMatrix::operator+=(const SymmetricMatrix& rhs) {
+	for (msize_t k=0; k<size(); k++)
+		data[k] += rhs.data[k];
+	return *this;
+}
+
+SymmetricMatrix& SymmetricMatrix::operator-=(const SymmetricMatrix& rhs) {
+	for (msize_t k=0; k<size(); k++)
+		data[k] -= rhs.data[k];
+	return *this;
+}
+
+SymmetricMatrix& SymmetricMatrix::operator*=(double scalar) {
+	for (msize_t k=0; k<size(); k++)
+		data[k] *= scalar;
+	return *this;
+}
+
+double SymmetricMatrix::trace() const {
+	double result = 0.0;
+	for (mdim_t i=0; i<n; i++)
+		result += data[packed(i, i)];
+	return result;
+}
+
+SymmetricMatrix SymmetricMatrix::sandwich(const Matrix& A, const SymmetricMatrix& P) {
+	SymmetricMatrix result;
+	sandwich_into(result, A, P);
+	return result;
+}
+
+// stores lane l of v as element (i0 + l, j) of the packed out, for the
+// rows of the block that reach column j
+static inline void store_column(double* out, simd_d v, mdim_t i0, mdim_t rows, mdim_t j) {
+	double lanes[SIMD_WIDTH];
+	simd_store(lanes, v);
+	for (mdim_t l=0; l<rows; l++)
+		if (j <= i0 + l)
+			out[(msize_t)(i0 + l) * (i0 + l + 1) / 2 + j] = lanes[l];
+}
+
+SymmetricMatrix& SymmetricMatrix::sandwich_into(SymmetricMatrix& out, const Matrix& A, const SymmetricMatrix& P) {
+	if (A.n != P.n) {
+		out.allocate(0);
+		return out;
+	}
+	mdim_t m = A.m;
+	mdim_t n = P.n;
+	if (out.n != m)
+		out.allocate(m);
+	MATRIX_STATS_OP(MATRIX_OP_DOT, 2.0 * m * n * n + (double)m * (m + 1) * n);
+
+	// SIMD_WIDTH rows of A at a time, one per lane: x[r] holds their
+	// column r and t[c] column c of their product with P, so both passes
+	// are vector multiply-adds against broadcast elements of P and A
+	const mdim_t W = SIMD_WIDTH;
+	ptrdiff_t rs = A.isTransposed ? 1 : A.n;
+	ptrdiff_t cs = A.isTransposed ? A.m : 1;
+	double small[2 * 32 * SIMD_WIDTH];
+	MatrixAllocator* allocator = n > 32 ? MatrixAllocator::current() : 0;
+	double* x = allocator ? (double*)allocator->allocate(2 * n * W * sizeof(double)) : small;
+	double* t = x + n * W;
+	for (mdim_t i0=0; i0<m; i0+=W) {
+		mdim_t rows = m - i0 < W ? m - i0 : W;
+		for (mdim_t r=0; r<n; r++)
+			for (mdim_t l=0; l<W; l++)
+				x[r * W + l] = l < rows ? A.data[(i0 + l) * rs + r * cs] : 0.0;
+
+		// packed row r of P holds P(r, 0..r): it adds x[r] times itself to
+		// t[0..r-1] and, against x[0..r], gives t[r]
+		const double* p = P.data;
+		for (mdim_t r=0; r<n; r++) {
+			simd_d xr = simd_load(x + r * W);
+			simd_d acc = simd_mul(simd_set1(p[r]), xr);
+			for (mdim_t c=0; c<r; c++) {
+				simd_d pc = simd_set1(p[c]);
+				simd_store(t + c * W, simd_fmadd(pc, xr, simd_load(t + c * W)));
+				acc = simd_fmadd(pc, simd_load(x + c * W), acc);
+			}
+			simd_store(t + r * W, acc);
+			p += r + 1;
+		}
+
+		// out(i, j) = t_i . a_j for j <= i, four columns at a time
+		mdim_t jend = i0 + rows;
+		mdim_t j = 0;
+		for (; j + 4 <= jend; j += 4) {
+			const double* a = A.data + j * rs;
+			simd_d acc0 = simd_set1(0.0), acc1 = acc0, acc2 = acc0, acc3 = acc0;
+			for (mdim_t k=0; k<n; k++) {
+				simd_d tk = simd_load(t + k * W);
+				const double* ak = a + k * cs;
+				acc0 = simd_fmadd(tk, simd_set1(ak[0]), acc0);
+				acc1 = simd_fmadd(tk, simd_set1(ak[rs]), acc1);
+				acc2 = simd_fmadd(tk, simd_set1(ak[2 * rs]), acc2);
+				acc3 = simd_fmadd(tk, simd_set1(ak[3 * rs]), acc3);
+			}
+			store_column(out.data, acc0, i0, rows, j);
+			store_column(out.data, acc1, i0, rows, j + 1);
+			store_column(out.data, acc2, i0, rows, j + 2);
+			store_column(out.data, acc3, i0, rows, j + 3);
+		}
+		for (; j<jend; j++) {
+			const double* a = A.data + j * rs;
+			simd_d acc = simd_set1(0.0);
+			for (mdim_t k=0; k<n; k++)
+				acc = simd_fmadd(simd_load(t + k * W), simd_set1(a[k * cs]), acc);
+			store_column(out.data, acc, i0, rows, j);
+		}
+	}
+	if (allocator)
+		allocator->release(x, 2 * n * W * sizeof(double));
+	return out;
+}
+
+SymmetricMatrix& SymmetricMatrix::rankUpdate(const Matrix& X, double alpha) {
+	if (X.m != n)
+		return *this;
+	MATRIX_STATS_OP(MATRIX_OP_DOT, (double)n * (n + 1) * X.n);
+	double* row = data;
+	for (mdim_t i=0; i<n; i++) {
+		for (mdim_t j=0; j<=i; j++) {
+			double acc = 0.0;
+			for (mdim_t k=0; k<X.n; k++)
+				acc += X.get(i, k) * X.get(j, k);
+			row[j] += alpha * acc;
+		}
+		row += i + 1;
+	}
+	return *this;
+}
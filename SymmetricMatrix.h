@@ -0,0 +1,52 @@
+#ifndef SYMMETRICMATRIX_H_
+#define SYMMETRICMATRIX_H_
+
+#include "Matrix.h"
+
+// Symmetric n x n matrix stored as its packed lower triangle, row by row:
+// (i, j) with j <= i lives at data[i * (i + 1) / 2 + j]. Half the memory
+// of a dense covariance, and symmetric by construction, so propagation
+// cannot drift into an asymmetric P.
+//
+//    SymmetricMatrix P(Matrix::identity(6));
+//    P = SymmetricMatrix::sandwich(F, P);   // F * P * F^T, one pass
+//    P += Q;
+//    P.rankUpdate(G, 0.01);                 // P += 0.01 * G * G^T
+class SymmetricMatrix {
+public:
+	SymmetricMatrix(mdim_t n=0);
+	// only the lower triangle of A is read
+	explicit SymmetricMatrix(const Matrix& A);
+	SymmetricMatrix(const SymmetricMatrix& rhs);
+	SymmetricMatrix(SymmetricMatrix&& rhs);
+	~SymmetricMatrix();
+	SymmetricMatrix& operator=(const SymmetricMatrix& rhs);
+	SymmetricMatrix& operator=(SymmetricMatrix&& rhs);
+
+	// both (i, j) and (j, i) refer to the same element
+	double& operator()(mdim_t i, mdim_t j);
+	double get(mdim_t i, mdim_t j) const;
+	msize_t size() const; // stored elements, n * (n + 1) / 2
+	Matrix toMatrix() const;
+
+	SymmetricMatrix& operator+=(const SymmetricMatrix& rhs);
+	SymmetricMatrix& operator-=(const SymmetricMatrix& rhs);
+	SymmetricMatrix& operator*=(double scalar);
+	double trace() const;
+
+	// A * P * A^T for an m x n A, computing only the lower triangle:
+	// about 2mn^2 + m^2n flops against 2mn^2 + 2m^2n for two dense dots
+	static SymmetricMatrix sandwich(const Matrix& A, const SymmetricMatrix& P);
+	// same into out (reallocated only if it is not m x m); out must not be P
+	static SymmetricMatrix& sandwich_into(SymmetricMatrix& out, const Matrix& A, const SymmetricMatrix& P);
+	// this += alpha * X * X^T for an n x k X, lower triangle only
+	SymmetricMatrix& rankUpdate(const Matrix& X, double alpha=1.0);
+
+	double* data;
+	mdim_t n;
+
+private:
+	void allocate(mdim_t n);
+};
+
+#endif /* SYMMETRICMATRIX_H_ */
@@ -0,0 +1,77 @@
+#include "Transpose.h"
+#include "MatrixSimd.h"
+#include <stddef.h>
+
+// cache block, a multiple of every SIMD width
+#define TRANSPOSE_BLOCK 32
+
+static inline unsigned int min_u(unsigned int a, unsigned int b) {
+	return a < b ? a : b;
+}
+
+static inline void transpose_tile(const double* src, int srcStride, double* dst, int dstStride) {
+	simd_d r[SIMD_WIDTH];
+	for (int i=0; i<SIMD_WIDTH; i++)
+		r[i] = simd_load(src + (ptrdiff_t)i * srcStride);
+	simd_transpose(r);
+	for (int i=0; i<SIMD_WIDTH; i++)
+		simd_store(dst + (ptrdiff_t)i * dstStride, r[i]);
+}
+
+// a holds tile (i, j), b tile (j, i); afterwards each holds the other's transpose
+static inline void swap_tiles(double* a, double* b, int stride) {
+	simd_d ra[SIMD_WIDTH], rb[SIMD_WIDTH];
+	for (int i=0; i<SIMD_WIDTH; i++) {
+		ra[i] = simd_load(a + (ptrdiff_t)i * stride);
+		rb[i] = simd_load(b + (ptrdiff_t)i * stride);
+	}
+	simd_transpose(ra);
+	simd_transpose(rb);
+	for (int i=0; i<SIMD_WIDTH; i++) {
+		simd_store(b + (ptrdiff_t)i * stride, ra[i]);
+		simd_store(a + (ptrdiff_t)i * stride, rb[i]);
+	}
+}
+
+void transpose_copy(unsigned int rows, unsigned int cols,
+		const double* src, int srcStride, double* dst, int dstStride) {
+	unsigned int fullRows = rows / SIMD_WIDTH * SIMD_WIDTH;
+	unsigned int fullCols = cols / SIMD_WIDTH * SIMD_WIDTH;
+
+	for (unsigned int ib=0; ib<fullRows; ib+=TRANSPOSE_BLOCK)
+		for (unsigned int jb=0; jb<fullCols; jb+=TRANSPOSE_BLOCK) {
+			unsigned int iend = min_u(ib + TRANSPOSE_BLOCK, fullRows);
+			unsigned int jend = min_u(jb + TRANSPOSE_BLOCK, fullCols);
+			for (unsigned int i=ib; i<iend; i+=SIMD_WIDTH)
+				for (unsigned int j=jb; j<jend; j+=SIMD_WIDTH)
+					transpose_tile(src + (ptrdiff_t)i * srcStride + j, srcStride,
+							dst + (ptrdiff_t)j * dstStride + i, dstStride);
+		}
+
+	// ragged right columns and bottom rows
+	for (unsigned int i=0; i<rows; i++)
+		for (unsigned int j=(i < fullRows ? fullCols : 0); j<cols; j++)
+			dst[(ptrdiff_t)j * dstStride + i] = src[(ptrdiff_t)i * srcStride + j];
+}
+
+void transpose_square(unsigned int n, double* a, int stride) {
+	unsigned int full = n / SIMD_WIDTH * SIMD_WIDTH;
+
+	// pairs of blocks on and above the diagonal, tile by tile
+	for (unsigned int ib=0; ib<full; ib+=TRANSPOSE_BLOCK)
+		for (unsigned int jb=ib; jb<full; jb+=TRANSPOSE_BLOCK) {
+			unsigned int iend = min_u(ib + TRANSPOSE_BLOCK, full);
+			unsigned int jend = min_u(jb + TRANSPOSE_BLOCK, full);
+			for (unsigned int i=ib; i<iend; i+=SIMD_WIDTH)
+				for (unsigned int j=(jb == ib ? i : jb); j<jend; j+=SIMD_WIDTH)
+					swap_tiles(a + (ptrdiff_t)i * stride + j, a + (ptrdiff_t)j * stride + i, stride);
+		}
+
+	// rows past the last full tile against everything before them
+	for (unsigned int i=full; i<n; i++)
+		for (unsigned int j=0; j<i; j++) {
+			double tmp = a[(ptrdiff_t)i * stride + j];
+			a[(ptrdiff_t)i * stride + j] = a[(ptrdiff_t)j * stride + i];
+			a[(ptrdiff_t)j * stride + i] = tmp;
+		}
+}
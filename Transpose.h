@@ -0,0 +1,17 @@
+#ifndef TRANSPOSE_H_
+#define TRANSPOSE_H_
+
+// Physical transposes used by Matrix::contiguous/materialized. Both walk
+// the matrix in cache-sized blocks of SIMD register tiles (4x4 with AVX,
+// 2x2 with SSE2), so reads and writes stay within a few cache lines each
+// instead of striding across the whole matrix.
+
+// dst (cols x rows) = src^T, src is rows x cols; both are row-major with
+// the given row strides and must not overlap
+void transpose_copy(unsigned int rows, unsigned int cols,
+		const double* src, int srcStride, double* dst, int dstStride);
+
+// transposes the n x n row-major block at a in place
+void transpose_square(unsigned int n, double* a, int stride);
+
+#endif /* TRANSPOSE_H_ */
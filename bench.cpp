@@ -0,0 +1,708 @@
+#include <iostream>
+#include <chrono>
+#include <math.h>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Matrix.h"
+#include "BasicMatrix.h"
+#include "Gemm.h"
+#include "KalmanFilter.h"
+#include "QR.h"
+#include "QuaternionBatch.h"
+#include "MatrixBatch.h"
+#include "Parallel.h"
+#include "SparseMatrix.h"
+#include "SymmetricMatrix.h"
+
+// Usage: bench [--suite-only] [--save FILE] [--baseline FILE] [--tolerance 0.10] [--threads N]
+//   --save writes the suite as tab separated "name ns_per_op allocs_per_op gflops"
+//   lines, --baseline compares against such a file and exits with 1 when a case
+//   got slower than the tolerance or allocates more than before. The last
+//   section scales large operations from 1 to N threads (default: all), which
+//   needs a -DMATRIX_PARALLEL build to go past 1.
+
+static double now_ns() {
+	return std::chrono::duration<double, std::nano>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// counts every array allocation (Matrix storage and gemm scratch); out of
+// line so GCC never pairs the malloc() in one with the free() in the other
+#if defined(__GNUC__)
+#define BENCH_NOINLINE __attribute__((noinline))
+#else
+#define BENCH_NOINLINE
+#endif
+static unsigned long allocations = 0;
+BENCH_NOINLINE void* operator new[](size_t size) {
+	allocations++;
+	void* p = malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+BENCH_NOINLINE void operator delete[](void* p) noexcept {
+	free(p);
+}
+BENCH_NOINLINE void operator delete[](void* p, size_t) noexcept {
+	free(p);
+}
+
+static volatile double sink;
+
+struct BenchResult {
+	char name[64];
+	double ns;
+	double allocs;
+	double gflops;
+};
+
+static const int MAX_RESULTS = 256;
+static BenchResult results[MAX_RESULTS];
+static int resultCount = 0;
+
+// Times f() in batches of at least ~5 ms and keeps the fastest batch,
+// which is the most repeatable number on a busy machine.
+template<class F>
+static void measure(const char* name, double flops, F f) {
+	f(); // warm up caches and allocator
+	int reps = 1;
+	double t0 = now_ns();
+	f();
+	double once = now_ns() - t0;
+	if (once < 5e6)
+		reps = (int)(5e6 / (once > 1.0 ? once : 1.0)) + 1;
+
+	double best = 1e300;
+	unsigned long allocs = 0;
+	for (int batch=0; batch<5; batch++) {
+		unsigned long before = allocations;
+		t0 = now_ns();
+		for (int r=0; r<reps; r++)
+			f();
+		double ns = (now_ns() - t0) / reps;
+		allocs = allocations - before;
+		if (ns < best)
+			best = ns;
+	}
+
+	if (resultCount == MAX_RESULTS)
+		return;
+	BenchResult& r = results[resultCount++];
+	snprintf(r.name, sizeof(r.name), "%s", name);
+	r.ns = best;
+	r.allocs = (double)allocs / reps;
+	r.gflops = flops > 0 ? flops / best : 0.0;
+	printf("%-34s %14.1f %10.2f %10.3f\n", r.name, r.ns, r.allocs, r.gflops);
+}
+
+static void fill(Matrix& a, double seed) {
+	for (mdim_t i=0; i<a.m; i++)
+		for (mdim_t j=0; j<a.n; j++)
+			a(i, j) = sin(seed + 0.37 * i + 0.11 * j) + (i == j ? a.n : 0.0);
+}
+
+// max |a - b| over all elements
+static double max_error(const Matrix& a, const Matrix& b) {
+	double worst = 0.0;
+	for (mdim_t i=0; i<a.m && i<b.m; i++)
+		for (mdim_t j=0; j<a.n && j<b.n; j++)
+			if (fabs(a.get(i, j) - b.get(i, j)) > worst)
+				worst = fabs(a.get(i, j) - b.get(i, j));
+	return worst;
+}
+
+// BasicMatrix::inverse exists for floating-point elements only
+template<typename T, bool floating = ScalarTraits<T>::floating>
+struct ScalarInverse {
+	static double run(const char*, const Matrix&) { return -1.0; }
+};
+
+template<typename T>
+struct ScalarInverse<T, true> {
+	static double run(const char* type, const Matrix& M) {
+		char name[64];
+		BasicMatrix<T> m(M), work(M);
+		Matrix inv = M;
+		inv.inverse();
+		double error = max_error(work.inverse().toMatrix(), inv);
+		snprintf(name, sizeof(name), "inverse_8_%s", type);
+		measure(name, 2.0 * 8 * 8 * 8, [&]() { work.copyData(m.data); work.inverse(); sink = work.data[0]; });
+		return error;
+	}
+};
+
+// dot, inverse (floating point only) and quaternion ops for one element
+// type, timed and compared against Matrix; inputs stay inside [-1, 1)
+template<typename T>
+static void bench_scalar(const char* type) {
+	char name[64];
+	Matrix A(16, 16), B(16, 16), M(8, 8);
+	for (mdim_t i=0; i<16; i++)
+		for (mdim_t j=0; j<16; j++) {
+			A(i, j) = 0.1 * sin(1.0 + i + 3.0 * j);
+			B(i, j) = 0.1 * cos(2.0 * i - j);
+		}
+	for (mdim_t i=0; i<8; i++)
+		for (mdim_t j=0; j<8; j++)
+			M(i, j) = (i == j ? 0.9 : 0.0) + 0.05 * sin(i + 2.0 * j);
+	double q_[] = {0.45576804, 0.060003, 0.5406251, 0.70455634};
+	double p_[] = {0.5, 0.5, -0.5, 0.5};
+	double v_[] = {0.5, -0.3, 0.2};
+	Matrix q(1, 4, q_), p(1, 4, p_), v(1, 3, v_);
+	q.normalize();
+	BasicMatrix<T> a(A), b(B), qt(q), pt(p), vt(v);
+
+	BasicMatrix<T> c = a.dot(b);
+	double dotError = max_error(c.toMatrix(), A.dot(B));
+	snprintf(name, sizeof(name), "dot_16_%s", type);
+	measure(name, 2.0 * 16 * 16 * 16, [&]() { BasicMatrix<T> r = a.dot(b); sink = ScalarTraits<T>::toDouble(r.data[0]); });
+
+	double inverseError = ScalarInverse<T>::run(type, M);
+
+	double multiplyError = max_error(qt.quaternion_multiply(pt).toMatrix(), q.quaternion_multiply(p));
+	double rotateError = max_error(vt.quaternion_rotate(qt, true).toMatrix(), v.quaternion_rotate(q, true));
+	snprintf(name, sizeof(name), "quaternion_multiply_%s", type);
+	measure(name, 28.0, [&]() { BasicMatrix<T> r = qt.quaternion_multiply(pt); sink = ScalarTraits<T>::toDouble(r.data[0]); });
+	snprintf(name, sizeof(name), "quaternion_rotate_unit_%s", type);
+	measure(name, 56.0, [&]() { BasicMatrix<T> r = vt.quaternion_rotate(qt, true); sink = ScalarTraits<T>::toDouble(r.data[0]); });
+	char inverseText[16];
+	if (inverseError < 0.0)
+		snprintf(inverseText, sizeof(inverseText), "n/a");
+	else
+		snprintf(inverseText, sizeof(inverseText), "%.2e", inverseError);
+	printf("  %s max error: dot %.2e, inverse %s, quaternion_multiply %.2e, quaternion_rotate %.2e\n",
+			type, dotError, inverseText, multiplyError, rotateError);
+}
+
+static void bench_suite() {
+	printf("%-34s %14s %10s %10s\n", "case", "ns/op", "allocs/op", "GFLOP/s");
+	char name[64];
+
+	mdim_t sizes[] = {3, 4, 8, 32, 128};
+	for (unsigned int s=0; s<sizeof(sizes)/sizeof(sizes[0]); s++) {
+		mdim_t n = sizes[s];
+		Matrix a(n, n), b(n, n), work(n, n);
+		fill(a, 0.0);
+		fill(b, 1.0);
+		Matrix at = a.transposed();
+		Matrix bt = b.transposed();
+		double flops = 2.0 * n * n * n;
+
+		const char* labels[] = {"NN", "TN", "NT", "TT"};
+		for (int t=0; t<4; t++) {
+			const Matrix& x = (t & 1) ? at : a;
+			const Matrix& y = (t & 2) ? bt : b;
+			snprintf(name, sizeof(name), "dot_%s_%u", labels[t], (unsigned int)n);
+			measure(name, flops, [&]() { Matrix c = x.dot(y); sink = c.data[0]; });
+			snprintf(name, sizeof(name), "dot_left_%s_%u", labels[t], (unsigned int)n);
+			measure(name, flops, [&]() { Matrix c = x.dot(y, true); sink = c.data[0]; });
+		}
+
+		Matrix out(n, n);
+		snprintf(name, sizeof(name), "dot_into_%u", (unsigned int)n);
+		measure(name, flops, [&]() { Matrix::dot_into(out, a, b); sink = out.data[0]; });
+		snprintf(name, sizeof(name), "dot_into_TN_%u", (unsigned int)n);
+		measure(name, flops, [&]() { Matrix::dot_into(out, a, b, 1.0, 0.0, true); sink = out.data[0]; });
+		snprintf(name, sizeof(name), "dotSelf_%u", (unsigned int)n);
+		measure(name, flops, [&]() { work.copyData(a.data); work.dotSelf(b); sink = work.data[0]; });
+		snprintf(name, sizeof(name), "dotSelf_left_%u", (unsigned int)n);
+		measure(name, flops, [&]() { work.copyData(a.data); work.dotSelf(b, true); sink = work.data[0]; });
+		snprintf(name, sizeof(name), "inverse_%u", (unsigned int)n);
+		measure(name, flops, [&]() { work.copyData(a.data); work.inverse(); sink = work.data[0]; });
+		Matrix x(n, 1), y(n, 1);
+		fill(x, 2.0);
+		snprintf(name, sizeof(name), "matvec_into_%u", (unsigned int)n);
+		measure(name, 2.0 * n * n, [&]() { Matrix::dot_into(y, a, x); sink = y.data[0]; });
+		snprintf(name, sizeof(name), "trace_%u", (unsigned int)n);
+		measure(name, (double)n, [&]() { sink = a.trace(); });
+		snprintf(name, sizeof(name), "norm_%u", (unsigned int)n);
+		measure(name, 2.0 * n * n, [&]() { sink = a.norm(); });
+		snprintf(name, sizeof(name), "normalize_%u", (unsigned int)n);
+		measure(name, 3.0 * n * n, [&]() { work.copyData(a.data); work.normalize(); sink = work.data[0]; });
+		snprintf(name, sizeof(name), "contiguous_%u", (unsigned int)n);
+		measure(name, 0.0, [&]() { work.transpose(); work.contiguous(); sink = work.data[1]; });
+		snprintf(name, sizeof(name), "materialized_%u", (unsigned int)n);
+		measure(name, 0.0, [&]() { Matrix c = at.materialized(); sink = c.data[1]; });
+		snprintf(name, sizeof(name), "submatrix_%u", (unsigned int)n);
+		measure(name, 0.0, [&]() { Matrix c = a.submatrix(0, 0, n / 2, n / 2); sink = c.data[0]; });
+	}
+
+	// covariance propagation F P F^T, dense against packed
+	mdim_t states[] = {6, 15};
+	for (int s=0; s<2; s++) {
+		mdim_t n = states[s];
+		Matrix F(n, n), P(n, n);
+		fill(F, 0.2);
+		fill(P, 0.0);
+		P = P.dot(P.transposed());
+		SymmetricMatrix Ps(P), out(n);
+		double flops = 4.0 * n * n * n;
+		snprintf(name, sizeof(name), "propagate_dense_%u", (unsigned int)n);
+		measure(name, flops, [&]() { Matrix c = F.dot(P).dot(F.transposed()); sink = c.data[0]; });
+		snprintf(name, sizeof(name), "propagate_packed_%u", (unsigned int)n);
+		measure(name, flops, [&]() { SymmetricMatrix::sandwich_into(out, F, Ps); sink = out.data[0]; });
+	}
+
+	// one predict + update of a 9-state filter with 3 measurements, the
+	// textbook Matrix form against KalmanFilter (sequential, Joseph form)
+	{
+		const mdim_t N = 9, M = 3;
+		Matrix F(N, N), Q(N, N), H(M, N), R(M, M), P = Matrix::identity(N), x(N, 1), z(M, 1);
+		fill(F, 0.1);
+		F *= 1.0 / N;
+		for (mdim_t i=0; i<N; i++)
+			Q(i, i) = 0.01;
+		for (mdim_t i=0; i<M; i++) {
+			H(i, i * 3) = 1.0;
+			R(i, i) = 0.5;
+			z(i, 0) = 1.0 + i;
+		}
+		Matrix I = Matrix::identity(N);
+		KalmanFilter<N, M> kf;
+		kf.F = FixedMatrix<N, N>(F);
+		kf.Q = FixedMatrix<N, N>(Q);
+		kf.H = FixedMatrix<M, N>(H);
+		kf.setMeasurementNoise(FixedMatrix<M, M>(R));
+		FixedMatrix<M, 1> zf(z);
+		measure("kalman_step_dense_9x3", 0.0, [&]() {
+			x = F.dot(x);
+			P = F.dot(P).dot(F.transposed()) + Q;
+			Matrix S = H.dot(P).dot(H.transposed()) + R;
+			Matrix K = P.dot(H.transposed()).dot(~S);
+			x = x + K.dot(z - H.dot(x));
+			Matrix IKH = I - K.dot(H);
+			P = IKH.dot(P);
+			sink = x.data[0];
+		});
+		measure("kalman_step_fixed_9x3", 0.0, [&]() {
+			kf.predict();
+			kf.update(zf);
+			sink = kf.x.data[0];
+		});
+		printf("%-34s %14.0f\n%-34s %14.0f\n", "  dense steps/s", 1e9 / results[resultCount - 2].ns,
+			"  fixed steps/s", 1e9 / results[resultCount - 1].ns);
+	}
+
+#ifndef MATRIX_COMPACT
+	// affine calibration fit over 2000 samples: normal equations, QR, and
+	// the streaming update per incoming sample
+	{
+		Matrix samples(2000, 4), targets(2000, 4), G(4, 4);
+		fill(G, 0.9);
+		for (mdim_t i=0; i<samples.m; i++) {
+			samples(i, 0) = 1000.0 * sin(0.1 * i);
+			samples(i, 1) = -800.0 * cos(0.37 * i);
+			samples(i, 2) = 1200.0 * sin(0.53 * i + 1.0);
+			samples(i, 3) = 1.0;
+		}
+		targets = samples.dot(G);
+		measure("calibration_normal_2000x4", 0.0, [&]() {
+			Matrix At = samples.transposed();
+			Matrix normal = At.dot(samples);
+			Matrix x = normal.inverse().dot(At.dot(targets));
+			sink = x.data[0];
+		});
+		measure("calibration_lstsq_2000x4", 0.0, [&]() { Matrix x = lstsq(samples, targets); sink = x.data[0]; });
+		IncrementalQR fit(4, 4, 0.999);
+		mdim_t row = 0;
+		measure("calibration_stream_row_4x4", 0.0, [&]() {
+			fit.addRow(samples.data + (msize_t)row * 4, targets.data + (msize_t)row * 4);
+			row = (row + 1) % samples.m;
+			sink = fit.R.data[0];
+		});
+		Matrix big(400, 200);
+		fill(big, 0.7);
+		double flops = 2.0 * 200 * 200 * (400 - 200 / 3.0);
+		QR qr;
+		measure("qr_400x200", flops, [&]() { qr.factor(big); sink = qr.qr.data[0]; });
+	}
+#endif
+
+	// 95% sparse Jacobian against a block of state vectors
+	Matrix J(128, 128), X(128, 16);
+	for (mdim_t i=0; i<128; i++)
+		for (mdim_t j=0; j<128; j++)
+			if ((i * 7 + j * 13) % 20 == 0)
+				J(i, j) = 1.0 + 0.01 * i;
+	fill(X, 0.5);
+	SparseMatrix S(J);
+	measure("dense_jacobian_dot_128x16", 2.0 * 128 * 128 * 16, [&]() { Matrix c = J.dot(X); sink = c.data[0]; });
+	measure("sparse_jacobian_dot_128x16", 2.0 * S.nonZeros() * 16, [&]() { Matrix c = S.dot(X); sink = c.data[0]; });
+
+	double q_[] = {0.45576804, 0.060003, 0.5406251, 0.70455634};
+	double p_[] = {0.9, 0.1, -0.2, 0.3};
+	double v_[] = {1.0, -2.0, 0.5};
+	double w_[] = {0.3, 0.2, -1.0};
+	Matrix q(1, 4, q_), p(1, 4, p_), v(1, 3, v_), w(1, 3, w_);
+	// the same kernels per element type
+	bench_scalar<double>("double");
+	bench_scalar<float>("float");
+	bench_scalar<Q31>("q31");
+	bench_scalar<Q15>("q15");
+
+	measure("cross", 9.0, [&]() { Matrix c = v.cross(w); sink = c.data[0]; });
+	measure("quaternion_multiply", 28.0, [&]() { Matrix c = q.quaternion_multiply(p); sink = c.data[0]; });
+	Matrix out(1, 4);
+	measure("cross_into", 9.0, [&]() { Matrix::cross_into(out, v, w); sink = out.data[0]; });
+	measure("quaternion_multiply_into", 28.0, [&]() { Matrix::quaternion_multiply_into(out, q, p); sink = out.data[0]; });
+	measure("quaternion_inverse", 11.0, [&]() { Matrix c = q.quaternion_inverse(); sink = c.data[0]; });
+	measure("quaternion_rotate", 45.0, [&]() { Matrix c = v.quaternion_rotate(q); sink = c.data[0]; });
+	measure("quaternion_rotate_unit", 30.0, [&]() { Matrix c = v.quaternion_rotate(q, true); sink = c.data[0]; });
+
+	double A_[] = { 0.70710678,  0.0,          0.70710678};
+	double B_[] = { 0.0,         0.70710678,   0.70710678};
+	double A2_[] = {0, 1, 0};
+	double B2_[] = {0., 0.5, 0.8660254};
+	Matrix A(1,3,A_), B(1,3,B_), A2(1,3,A2_), B2(1,3,B2_);
+	Matrix a_(1, 3), b_(1, 3), Q(1, 4);
+	// estimate_quaternion normalizes its inputs in place, so feed it copies
+	measure("estimate_quaternion", 0.0, [&]() {
+		a_.copyData(A_);
+		b_.copyData(B_);
+		Matrix c = Matrix::estimate_quaternion(a_, b_, A2, B2);
+		sink = c.data[0];
+	});
+	measure("estimate_quaternion_into", 0.0, [&]() { sink = Matrix::estimate_quaternion_into(Q, A, B, A2, B2).data[0]; });
+
+	// 1024 independent transforms per tick: one Matrix each against one batch
+	const msize_t K = 1024;
+	for (mdim_t n=3; n<=4; n++) {
+		Matrix* a = new Matrix[K];
+		Matrix* b = new Matrix[K];
+		Matrix* c = new Matrix[K];
+		MatrixBatch ab(n, n, K), bb(n, n, K), cb, work;
+		for (msize_t k=0; k<K; k++) {
+			a[k] = Matrix(n, n);
+			b[k] = Matrix(n, n);
+			c[k] = Matrix(n, n);
+			fill(a[k], k * 0.01);
+			fill(b[k], 1.0 + k * 0.01);
+			for (mdim_t i=0; i<n; i++)
+				a[k](i, i) += n; // keep them invertible
+			ab.set(k, a[k]);
+			bb.set(k, b[k]);
+		}
+		double flops = 2.0 * n * n * n * K;
+		snprintf(name, sizeof(name), "dot_into_%ux%ux%u", (unsigned int)K, (unsigned int)n, (unsigned int)n);
+		measure(name, flops, [&]() { for (msize_t k=0; k<K; k++) Matrix::dot_into(c[k], a[k], b[k]); sink = c[0].data[0]; });
+		snprintf(name, sizeof(name), "batch_dot_%ux%ux%u", (unsigned int)K, (unsigned int)n, (unsigned int)n);
+		measure(name, flops, [&]() { ab.dot(bb, cb); sink = cb.data[0]; });
+		snprintf(name, sizeof(name), "inverse_%ux%ux%u", (unsigned int)K, (unsigned int)n, (unsigned int)n);
+		measure(name, 0.0, [&]() { for (msize_t k=0; k<K; k++) { c[k].copyData(a[k].data); c[k].inverse(); } sink = c[0].data[0]; });
+		snprintf(name, sizeof(name), "batch_inverse_%ux%ux%u", (unsigned int)K, (unsigned int)n, (unsigned int)n);
+		measure(name, 0.0, [&]() { ab.inverse(cb); sink = cb.data[0]; });
+		snprintf(name, sizeof(name), "batch_transpose_%ux%ux%u", (unsigned int)K, (unsigned int)n, (unsigned int)n);
+		measure(name, 0.0, [&]() { ab.transpose(cb); sink = cb.data[1]; });
+		snprintf(name, sizeof(name), "norm_%ux%ux%u", (unsigned int)K, (unsigned int)n, (unsigned int)n);
+		measure(name, 2.0 * n * n * K, [&]() { for (msize_t k=0; k<K; k++) sink += a[k].norm(); });
+		double norms[K];
+		snprintf(name, sizeof(name), "batch_norm_%ux%ux%u", (unsigned int)K, (unsigned int)n, (unsigned int)n);
+		measure(name, 2.0 * n * n * K, [&]() { ab.norm(norms); sink = norms[0]; });
+		snprintf(name, sizeof(name), "batch_normalize_%ux%ux%u", (unsigned int)K, (unsigned int)n, (unsigned int)n);
+		measure(name, 3.0 * n * n * K, [&]() { ab.transpose(work); work.normalize(); sink = work.data[0]; });
+		snprintf(name, sizeof(name), "batch_gather_%ux%ux%u", (unsigned int)K, (unsigned int)n, (unsigned int)n);
+		measure(name, 0.0, [&]() { for (msize_t k=0; k<K; k++) ab.get(k, c[k]); sink = c[0].data[0]; });
+		delete[] a;
+		delete[] b;
+		delete[] c;
+	}
+}
+
+#ifndef MATRIX_COMPACT
+static void bench_parallel(unsigned int maxThreads) {
+	const mdim_t N = 1000;
+	Matrix A(N, N), B(N, N), C(N, N);
+	fill(A, 0.0);
+	fill(B, 1.0);
+	Matrix big(2000, 2000), other(2000, 2000);
+	fill(big, 2.0);
+	fill(other, 3.0);
+
+	printf("\nparallel scaling (ms, speedup against 1 thread)\n");
+	printf("threads\tdot_1000\t\tadd_2000\t\tsum_2000\n");
+	double base[3] = {0, 0, 0};
+	for (unsigned int t=1; t<=maxThreads; t++) {
+		MatrixParallel::setThreads(t);
+		if (MatrixParallel::threads() != t)
+			break; // serial build
+		double ms[3];
+		double t0 = now_ns();
+		C = A.dot(B);
+		ms[0] = (now_ns() - t0) / 1e6;
+		t0 = now_ns();
+		for (int r=0; r<10; r++)
+			big += other;
+		ms[1] = (now_ns() - t0) / 1e7;
+		t0 = now_ns();
+		for (int r=0; r<10; r++)
+			sink = big.sum();
+		ms[2] = (now_ns() - t0) / 1e7;
+		if (t == 1)
+			for (int i=0; i<3; i++)
+				base[i] = ms[i];
+		printf("%u", t);
+		for (int i=0; i<3; i++)
+			printf("\t%.2f (%.2fx)", ms[i], base[i] / ms[i]);
+		printf("\n");
+	}
+	MatrixParallel::setThreads(0);
+}
+#endif
+
+static bool save_results(const char* path) {
+	FILE* f = fopen(path, "w");
+	if (!f)
+		return false;
+	for (int i=0; i<resultCount; i++)
+		fprintf(f, "%s\t%.3f\t%.3f\t%.4f\n", results[i].name, results[i].ns, results[i].allocs, results[i].gflops);
+	fclose(f);
+	return true;
+}
+
+// returns the number of regressions, or -1 if the baseline can't be read
+static int compare_results(const char* path, double tolerance) {
+	FILE* f = fopen(path, "r");
+	if (!f)
+		return -1;
+	printf("\n%-34s %14s %14s %8s %12s\n", "case", "baseline_ns", "ns", "ratio", "allocs");
+	int regressions = 0;
+	char line[256];
+	while (fgets(line, sizeof(line), f)) {
+		BenchResult base;
+		if (sscanf(line, "%63s %lf %lf %lf", base.name, &base.ns, &base.allocs, &base.gflops) != 4)
+			continue;
+		const BenchResult* now = 0;
+		for (int i=0; i<resultCount && !now; i++)
+			if (!strcmp(results[i].name, base.name))
+				now = &results[i];
+		if (!now)
+			continue;
+		double ratio = now->ns / base.ns;
+		bool slower = ratio > 1.0 + tolerance;
+		bool moreAllocs = now->allocs > base.allocs + 1e-9;
+		if (slower || moreAllocs)
+			regressions++;
+		printf("%-34s %14.1f %14.1f %8.3f %5.2f->%-5.2f %s\n", base.name, base.ns, now->ns, ratio,
+				base.allocs, now->allocs, slower || moreAllocs ? "REGRESSION" : (ratio < 1.0 - tolerance ? "faster" : ""));
+	}
+	fclose(f);
+	printf("%d regression(s) at %.0f%% tolerance\n", regressions, tolerance * 100);
+	return regressions;
+}
+
+// the textbook loop Matrix::dot used before gemm, including the
+// transpose branch on every element access
+static inline double at(const double* p, unsigned int rows, unsigned int cols, bool transposed, unsigned int i, unsigned int j) {
+	return transposed ? p[j * rows + i] : p[i * cols + j];
+}
+
+static void naive_dot(unsigned int size, const double* a, bool ta, const double* b, bool tb, double* c) {
+	for (unsigned int i=0; i<size; i++)
+		for (unsigned int j=0; j<size; j++) {
+			double acc = 0.0;
+			for (unsigned int k=0; k<size; k++)
+				acc += at(a, size, size, ta, i, k) * at(b, size, size, tb, k, j);
+			c[i * size + j] = acc;
+		}
+}
+
+static void bench_gemm() {
+	unsigned int sizes[] = {8, 16, 32, 64, 128, 256, 512};
+	std::cout << "dot: naive loop vs gemm (square, ns/op and GFLOP/s)\n";
+	std::cout << "size\ttransA\ttransB\tnaive_ns\tgemm_ns\tnaive_gflops\tgemm_gflops\tspeedup\n";
+	for (unsigned int s=0; s<sizeof(sizes)/sizeof(sizes[0]); s++) {
+		unsigned int size = sizes[s];
+		double* a = new double[size * size];
+		double* b = new double[size * size];
+		double* c = new double[size * size];
+		for (unsigned int i=0; i<size * size; i++) {
+			a[i] = sin(i * 0.1);
+			b[i] = cos(i * 0.1);
+		}
+		double flops = 2.0 * size * size * size;
+		int reps = (int)(2e8 / flops) + 1;
+
+		for (int ta=0; ta<2; ta++)
+			for (int tb=0; tb<2; tb++) {
+				double t0 = now_ns();
+				for (int r=0; r<reps; r++)
+					naive_dot(size, a, ta, b, tb, c);
+				double naive = (now_ns() - t0) / reps;
+
+				t0 = now_ns();
+				for (int r=0; r<reps; r++)
+					gemm(size, size, size, 1.0,
+							a, ta ? 1 : size, ta ? size : 1,
+							b, tb ? 1 : size, tb ? size : 1,
+							0.0, c, size, 1);
+				double fast = (now_ns() - t0) / reps;
+
+				std::cout << size << "\t" << ta << "\t" << tb << "\t"
+						<< naive << "\t" << fast << "\t"
+						<< flops / naive << "\t" << flops / fast << "\t"
+						<< naive / fast << "\n";
+			}
+		delete[] a;
+		delete[] b;
+		delete[] c;
+	}
+}
+
+#ifndef MATRIX_COMPACT
+static void bench_large() {
+	// a batch of 1k sensor samples (rows) against a 1k x 1k model
+	const mdim_t N = 1000;
+	Matrix A(N, N);
+	Matrix B(N, N);
+	for (mdim_t i=0; i<N; i++)
+		for (mdim_t j=0; j<N; j++) {
+			A(i, j) = sin(i * 0.01 + j);
+			B(i, j) = cos(i + j * 0.01);
+		}
+	Matrix samples(N, 3);
+	double flops = 2.0 * N * N * N;
+
+	std::cout << "\n1k x 1k Matrix operations (ns/op)\n";
+	double t0 = now_ns();
+	Matrix C = A.dot(B);
+	double t = now_ns() - t0;
+	std::cout << "dot 1000x1000 * 1000x1000\t" << t << "\t" << flops / t << " GFLOP/s\n";
+
+	t0 = now_ns();
+	C = A.transposed().dot(B, true);
+	t = now_ns() - t0;
+	std::cout << "dot left, transposed 1000x1000\t" << t << "\t" << flops / t << " GFLOP/s\n";
+
+	t0 = now_ns();
+	Matrix projected = A.dot(samples);
+	t = now_ns() - t0;
+	std::cout << "dot 1000x1000 * 1000x3\t" << t << "\n";
+
+	t0 = now_ns();
+	C = A + B * 0.5;
+	t = now_ns() - t0;
+	std::cout << "A + B * 0.5 1000x1000\t" << t << "\n";
+
+	t0 = now_ns();
+	double norm = A.norm();
+	t = now_ns() - t0;
+	std::cout << "norm 1000x1000\t" << t << "\t(" << norm << ")\n";
+}
+#endif
+
+static void bench_quaternion_batch() {
+	const msize_t N = 20000;
+	VectorBatch v(N), out;
+	QuaternionBatch q(N);
+	for (msize_t i=0; i<N; i++) {
+		v.x[i] = sin(i * 0.1); v.y[i] = cos(i * 0.2); v.z[i] = 0.5;
+		q.w[i] = cos(i * 0.3); q.x[i] = 0.1; q.y[i] = sin(i * 0.3); q.z[i] = -0.2;
+	}
+	double q_[] = {0.45576804, 0.060003, 0.5406251, 0.70455634};
+	Matrix Q(1, 4, q_);
+
+	std::cout << "\nrotate " << N << " vectors (ns/vector)\n";
+	double sink = 0.0;
+	double t0 = now_ns();
+	for (msize_t i=0; i<N; i++)
+		sink += v.get(i).quaternion_rotate(Q)(0, 0);
+	std::cout << "Matrix::quaternion_rotate\t" << (now_ns() - t0) / N << "\t(" << sink << ")\n";
+
+	t0 = now_ns();
+	QuaternionBatch::rotate(Q, v, out);
+	std::cout << "QuaternionBatch::rotate, one quaternion\t" << (now_ns() - t0) / N << "\n";
+
+	t0 = now_ns();
+	q.rotate(v, out);
+	std::cout << "QuaternionBatch::rotate, N quaternions\t" << (now_ns() - t0) / N << "\n";
+}
+
+static void bench_estimate_quaternion() {
+	const msize_t N = 4096;
+	double A_[] = { 0.70710678,  0.0,          0.70710678};
+	double B_[] = { 0.0,         0.70710678,   0.70710678};
+	double A2_[] = {0, 1, 0};
+	double B2_[] = {0., 0.5, 0.8660254};
+	Matrix A(1,3,A_), B(1,3,B_), A2(1,3,A2_), B2(1,3,B2_);
+	VectorBatch a(N), b(N), a2(N), b2(N);
+	for (msize_t i=0; i<N; i++) {
+		a.set(i, A); b.set(i, B); a2.set(i, A2); b2.set(i, B2);
+	}
+	QuaternionBatch q;
+	Matrix Q(1, 4);
+	double sink = 0.0;
+
+	std::cout << "\nestimate_quaternion (ns/estimate)\n";
+	double t0 = now_ns();
+	for (msize_t i=0; i<N; i++) {
+		Matrix a_ = A, b_ = B;
+		sink += Matrix::estimate_quaternion(a_, b_, A2, B2)(0, 0);
+	}
+	std::cout << "estimate_quaternion\t" << (now_ns() - t0) / N << "\n";
+
+	t0 = now_ns();
+	for (msize_t i=0; i<N; i++)
+		sink += Matrix::estimate_quaternion_into(Q, A, B, A2, B2)(0, 0);
+	std::cout << "estimate_quaternion_into\t" << (now_ns() - t0) / N << "\n";
+
+	t0 = now_ns();
+	QuaternionBatch::estimate(a, b, a2, b2, q);
+	std::cout << "QuaternionBatch::estimate\t" << (now_ns() - t0) / N << "\t(" << sink + q.w[0] << ")\n";
+}
+
+int main(int argc, char** argv)
+{
+	const char* savePath = 0;
+	const char* baselinePath = 0;
+	double tolerance = 0.10;
+	bool suiteOnly = false;
+	unsigned int maxThreads = 0;
+	for (int i=1; i<argc; i++) {
+		if (!strcmp(argv[i], "--suite-only"))
+			suiteOnly = true;
+		else if (!strcmp(argv[i], "--save") && i + 1 < argc)
+			savePath = argv[++i];
+		else if (!strcmp(argv[i], "--baseline") && i + 1 < argc)
+			baselinePath = argv[++i];
+		else if (!strcmp(argv[i], "--tolerance") && i + 1 < argc)
+			tolerance = atof(argv[++i]);
+		else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+			maxThreads = atoi(argv[++i]);
+		else {
+			fprintf(stderr, "usage: %s [--suite-only] [--save FILE] [--baseline FILE] [--tolerance 0.10] [--threads N]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	bench_suite();
+	if (savePath && !save_results(savePath)) {
+		fprintf(stderr, "cannot write %s\n", savePath);
+		return 2;
+	}
+	int regressions = 0;
+	if (baselinePath) {
+		regressions = compare_results(baselinePath, tolerance);
+		if (regressions < 0) {
+			fprintf(stderr, "cannot read %s\n", baselinePath);
+			return 2;
+		}
+	}
+	if (!suiteOnly) {
+		std::cout << "\n";
+		bench_gemm();
+#ifndef MATRIX_COMPACT
+		bench_large();
+#endif
+		bench_quaternion_batch();
+		bench_estimate_quaternion();
+#ifndef MATRIX_COMPACT
+		bench_parallel(maxThreads ? maxThreads : MatrixParallel::threads());
+#else
+		(void)maxThreads; // --threads is accepted but has nothing to size
+#endif
+	}
+	return regressions ? 1 : 0;
+}